@@ -0,0 +1,137 @@
+#include <DotNyet/VM/VirtualMachine.hpp>
+#include <DotNyet/Types/Value.hpp>
+#include <Util/Log.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Measures the per-instruction cost of each execution engine (both dispatch
+// modes of the interpreter, the fastest one without quickening, and the JIT
+// when the build has it) by running every
+// given program repeatedly with its output discarded and its input fed from a
+// fixed fixture. Only the time spent inside VirtualMachine::Run() is counted.
+
+namespace {
+    using DotNyet::VM::VirtualMachine;
+
+    constexpr double MinSecondsPerProgram = 0.2;
+    constexpr char NYET_MAGIC[4] = {'N', 'Y', 'E', 'T'};
+
+    struct Program {
+        std::vector<uint8_t> bytes;
+        uint8_t version = DotNyet::Bytecode::FormatVersion1;
+    };
+
+    Program ReadProgram(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            throw std::runtime_error("Failed to open bytecode file: " + path);
+
+        Program program;
+        program.bytes.assign(std::istreambuf_iterator<char>(file), {});
+        if (program.bytes.size() >= 5 && std::memcmp(program.bytes.data(), NYET_MAGIC, 4) == 0) {
+            program.version = program.bytes[4];
+            program.bytes.erase(program.bytes.begin(), program.bytes.begin() + 5);
+        }
+        return program;
+    }
+
+    struct Engine {
+        const char* name;
+        VirtualMachine::DispatchMode mode;
+        bool jit;
+        bool quickening = true;
+    };
+
+    struct Measurement {
+        uint64_t instructions = 0;
+        double seconds = 0.0;
+        size_t runs = 0;
+    };
+
+    Measurement Measure(const Program& program, const Engine& engine) {
+        using clock = std::chrono::steady_clock;
+
+        // Every INPUT reads a small number so programs like pyramid.ny stay valid
+        std::string fixture;
+        for (int i = 0; i < 64; i++)
+            fixture += "12\n";
+
+        Measurement m;
+        while (m.seconds < MinSecondsPerProgram) {
+            VirtualMachine vm;
+            vm.SetDispatchMode(engine.mode);
+            vm.SetJit(engine.jit);
+            vm.SetQuickening(engine.quickening);
+            vm.GetOutput().RedirectTo([](std::string_view) {});
+            vm.GetInput().RedirectTo([&fixture, offset = size_t{0}](char* buffer, size_t size) mutable {
+                size_t count = std::min(size, fixture.size() - offset);
+                std::memcpy(buffer, fixture.data() + offset, count);
+                offset += count;
+                return count;
+            });
+            vm.LoadBytecode(program.bytes, program.version);
+            vm.GetStack().Push(DotNyet::Types::Value(std::string()));
+
+            auto start = clock::now();
+            vm.Run();
+            m.seconds += std::chrono::duration<double>(clock::now() - start).count();
+
+            m.instructions += vm.GetExecutedInstructions();
+            m.runs++;
+        }
+        return m;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::fprintf(stderr, "Usage: %s <bytecode file>...\n", argv[0]);
+        return 1;
+    }
+
+    Util::Logger::SetLogLevel(Util::Logger::Level::Error);
+
+    std::vector<Engine> engines = {{"switch", VirtualMachine::DispatchMode::Switch, false}};
+    auto fastest = VirtualMachine::DispatchMode::Switch;
+    if (VirtualMachine::HasThreadedDispatch()) {
+        engines.push_back({"threaded", VirtualMachine::DispatchMode::Threaded, false});
+        fastest = VirtualMachine::DispatchMode::Threaded;
+    }
+    engines.push_back({"generic", fastest, false, false});
+    // Hot code runs compiled, the rest in the fastest interpreter
+    if (VirtualMachine::HasJit())
+        engines.push_back({"jit", fastest, true});
+
+    std::printf("%-24s %-10s %10s %14s %10s\n", "program", "engine", "runs", "instructions", "ns/op");
+    std::fflush(stdout);
+
+    int status = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string path = argv[i];
+        std::string name = path.substr(path.find_last_of("/\\") + 1);
+
+        try {
+            auto program = ReadProgram(path);
+            for (const auto& engine : engines) {
+                auto m = Measure(program, engine);
+                double nsPerOp = m.instructions ? m.seconds * 1e9 / static_cast<double>(m.instructions) : 0.0;
+                std::printf("%-24s %-10s %10zu %14llu %10.2f\n", name.c_str(), engine.name, m.runs,
+                    static_cast<unsigned long long>(m.instructions), nsPerOp);
+                std::fflush(stdout);
+            }
+        } catch (const std::exception& e) {
+            std::fprintf(stderr, "%s: %s\n", name.c_str(), e.what());
+            status = 1;
+        }
+    }
+
+    return status;
+}
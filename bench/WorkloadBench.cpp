@@ -0,0 +1,201 @@
+#include <DotNyet/VM/VirtualMachine.hpp>
+#include <DotNyet/Bytecode/MappedFile.hpp>
+#include <DotNyet/Types/Value.hpp>
+#include <Util/Log.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Runs each given workload repeatedly with the default engine and prints one
+// JSON object per workload on its own line: load and run time, instructions,
+// ops/sec and ns/op, heap allocations per run and peak RSS. Output is
+// discarded, and INPUT reads the fixture `<workload>.in` next to the bytecode
+// file (or nothing), so no workload ever waits for stdin. Every workload runs
+// in a child process of its own so its peak RSS is not inflated by the ones
+// before it.
+
+namespace {
+    // Heap allocations made through operator new by this process
+    uint64_t allocations = 0;
+    uint64_t allocatedBytes = 0;
+}
+
+void* operator new(std::size_t size) {
+    allocations++;
+    allocatedBytes += size;
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+    using DotNyet::VM::VirtualMachine;
+
+    struct Options {
+        double minSeconds = 0.5;
+        size_t minRuns = 3;
+    };
+
+    struct Workload {
+        std::string name;
+        std::shared_ptr<const DotNyet::Bytecode::MappedFile> file;
+        std::string fixture;
+    };
+
+    std::string ReadFile(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return {};
+        return std::string(std::istreambuf_iterator<char>(file), {});
+    }
+
+    // Maps the workload like dotnyet does; VirtualMachine::LoadImage reads its
+    // header (or snapshot) on every run
+    Workload ReadWorkload(const std::string& path) {
+        Workload workload;
+        workload.file = std::make_shared<const DotNyet::Bytecode::MappedFile>(path);
+        std::string base = path.substr(0, path.rfind(".nyet"));
+        workload.name = base.substr(base.find_last_of("/\\") + 1);
+        workload.fixture = ReadFile(base + ".in");
+        return workload;
+    }
+
+    struct Measurement {
+        size_t runs = 0;
+        double loadSeconds = 0.0;
+        double runSeconds = 0.0;
+        uint64_t instructions = 0;
+        uint64_t allocations = 0;
+        uint64_t allocatedBytes = 0;
+        uint64_t outputBytes = 0;
+    };
+
+    Measurement Measure(const Workload& workload, const Options& options) {
+        using clock = std::chrono::steady_clock;
+
+        Measurement m;
+        while (m.runs < options.minRuns || m.runSeconds < options.minSeconds) {
+            VirtualMachine vm;
+            vm.GetOutput().RedirectTo([&m](std::string_view text) { m.outputBytes += text.size(); });
+            vm.GetInput().RedirectTo([&workload, offset = size_t{0}](char* buffer, size_t size) mutable {
+                size_t count = std::min(size, workload.fixture.size() - offset);
+                std::memcpy(buffer, workload.fixture.data() + offset, count);
+                offset += count;
+                return count;
+            });
+
+            auto start = clock::now();
+            vm.LoadImage(workload.file->Bytes(), workload.file);
+            auto loaded = clock::now();
+            m.loadSeconds += std::chrono::duration<double>(loaded - start).count();
+
+            vm.GetStack().Push(DotNyet::Types::Value(std::string()));
+
+            uint64_t allocationsBefore = allocations;
+            uint64_t bytesBefore = allocatedBytes;
+            start = clock::now();
+            vm.Run();
+            m.runSeconds += std::chrono::duration<double>(clock::now() - start).count();
+            m.allocations += allocations - allocationsBefore;
+            m.allocatedBytes += allocatedBytes - bytesBefore;
+
+            m.instructions += vm.GetExecutedInstructions();
+            m.runs++;
+        }
+        return m;
+    }
+
+    void Report(const Workload& workload, const Measurement& m) {
+        struct rusage usage {};
+        getrusage(RUSAGE_SELF, &usage);
+
+        double runs = static_cast<double>(m.runs);
+        double instructions = static_cast<double>(m.instructions);
+        std::printf("{\"workload\":\"%s\",\"runs\":%zu,\"instructions\":%.0f,\"load_ns\":%.0f,\"run_ns\":%.0f,"
+                    "\"ops_per_sec\":%.0f,\"ns_per_op\":%.3f,\"allocations\":%.0f,\"allocated_bytes\":%.0f,"
+                    "\"output_bytes\":%.0f,\"peak_rss_kb\":%ld}\n",
+            workload.name.c_str(), m.runs, instructions / runs, m.loadSeconds * 1e9 / runs, m.runSeconds * 1e9 / runs,
+            m.runSeconds > 0 ? instructions / m.runSeconds : 0.0, m.instructions ? m.runSeconds * 1e9 / instructions : 0.0,
+            static_cast<double>(m.allocations) / runs, static_cast<double>(m.allocatedBytes) / runs,
+            static_cast<double>(m.outputBytes) / runs, usage.ru_maxrss);
+        std::fflush(stdout);
+    }
+
+    // Measures the workload at `path` in a child process; false if it failed
+    bool RunIsolated(const std::string& path, const Options& options) {
+        std::fflush(stdout);
+        pid_t pid = fork();
+        if (pid < 0) {
+            std::perror("fork");
+            return false;
+        }
+
+        if (pid == 0) {
+            int status = 0;
+            try {
+                auto workload = ReadWorkload(path);
+                Report(workload, Measure(workload, options));
+            } catch (const std::exception& e) {
+                std::fprintf(stderr, "%s: %s\n", path.c_str(), e.what());
+                status = 1;
+            }
+            std::fflush(stdout);
+            _exit(status);
+        }
+
+        int status = 0;
+        if (waitpid(pid, &status, 0) < 0) {
+            std::perror("waitpid");
+            return false;
+        }
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++) {
+        if (std::strncmp(argv[i], "--min-time=", 11) == 0)
+            options.minSeconds = std::strtod(argv[i] + 11, nullptr);
+        else
+            paths.push_back(argv[i]);
+    }
+
+    if (paths.empty()) {
+        std::fprintf(stderr, "Usage: %s [--min-time=SECONDS] <workload.nyet>...\n", argv[0]);
+        return 1;
+    }
+
+    Util::Logger::SetLogLevel(Util::Logger::Level::Error);
+
+    int status = 0;
+    for (const auto& path : paths) {
+        if (!RunIsolated(path, options))
+            status = 1;
+    }
+    return status;
+}
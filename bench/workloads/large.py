@@ -0,0 +1,54 @@
+"""Writes large.ny, a program of many small functions, to measure how long
+loading (decoding, verifying and fusing) a big program takes.
+
+Usage: large.py <output.ny> [functions]
+"""
+import sys
+
+def main():
+    output = sys.argv[1]
+    functions = int(sys.argv[2]) if len(sys.argv) > 2 else 4000
+
+    lines = ["# Generated by large.py"]
+    for f in range(functions):
+        lines += [
+            f"fn f{f}(x)",
+            "    var y",
+            "    var z",
+            "    pop x",
+            "    push x",
+            f"    push {f}",
+            "    add",
+            "    pop y",
+            "    z = 0",
+            f"loop{f}:",
+            "    push z",
+            "    push 3",
+            "    cmp",
+            f"    jnz done{f}",
+            "    push y",
+            "    push 2",
+            "    mul",
+            "    pop y",
+            "    push z",
+            "    push 1",
+            "    add",
+            "    pop z",
+            f"    jmp loop{f}",
+            f"done{f}:",
+            f'    push "f{f} "',
+            "    pop z",
+            "    return y",
+        ]
+
+    # main calls every function once so all of them are executed as well
+    lines += ["fn main()", "    var sum", "    sum = 0"]
+    for f in range(functions):
+        lines += ["    push 1", f"    f{f}()", "    push sum", "    add", "    pop sum"]
+    lines += ["    push sum", "    print", '    push "\\n"', "    print", "    return 0"]
+
+    with open(output, "w") as out:
+        out.write("\n".join(lines) + "\n")
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,36 @@
+# dotnyet_add_aot_executable(<target> <source>)
+#
+# Builds <target> as a native executable from a .ny script or a .nyet
+# bytecode file: the script is compiled with nyasm, translated to
+# C++ with `dotnyet --emit-cpp`, and the result is compiled and linked
+# against libdotnyet like any other source file.
+function(dotnyet_add_aot_executable target source)
+    get_filename_component(source ${source} ABSOLUTE)
+    get_filename_component(extension ${source} LAST_EXT)
+    set(output_dir ${CMAKE_CURRENT_BINARY_DIR}/${target}.aot)
+
+    if (extension STREQUAL ".nyet")
+        set(bytecode ${source})
+    else()
+        set(bytecode ${output_dir}/${target}.nyet)
+        add_custom_command(
+            OUTPUT ${bytecode}
+            COMMAND ${CMAKE_COMMAND} -E make_directory ${output_dir}
+            COMMAND $<TARGET_FILE:nyasm> ${source} ${bytecode}
+            DEPENDS ${source} nyasm
+            COMMENT "Compiling ${source}"
+        )
+    endif()
+
+    set(translated ${output_dir}/${target}.cpp)
+    add_custom_command(
+        OUTPUT ${translated}
+        COMMAND ${CMAKE_COMMAND} -E make_directory ${output_dir}
+        COMMAND $<TARGET_FILE:dotnyet> -l error --emit-cpp=${translated} ${bytecode}
+        DEPENDS ${bytecode} dotnyet
+        COMMENT "Translating ${target} to C++"
+    )
+
+    add_executable(${target} ${translated})
+    target_link_libraries(${target} PRIVATE libdotnyet)
+endfunction()
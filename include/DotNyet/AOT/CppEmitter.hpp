@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <DotNyet/Bytecode/Instruction.hpp>
+#include <Util/Log.hpp>
+
+namespace DotNyet::AOT {
+    // Translates a verified program into one C++ translation unit that links
+    // against libdotnyet (see Runtime.hpp).
+    //
+    // Every DEF becomes a C++ function holding the code reachable from its
+    // entry; jumps become gotos, locals and stack slots become C++ variables.
+    // A type analysis over each function finds the stack slots and locals that
+    // only ever hold ints or booleans. Those are plain int64_t variables and
+    // the arithmetic, comparisons and branches on them are emitted as native
+    // operations, so an optimizing C++ compiler turns integer loops into
+    // machine code loops. Everything else goes through Types::Value with the
+    // same semantics and errors as the interpreter. A function that calls
+    // itself right before returning jumps back to its start instead.
+    class CppEmitter {
+    public:
+        // `program` must be verified and not fused
+        explicit CppEmitter(const Bytecode::Program& program);
+
+        // Returns the C++ source; `origin` is only mentioned in its header comment
+        std::string Emit(std::string_view origin);
+
+    private:
+        const Bytecode::Program& program;
+        Util::Logger logger;
+
+        void EmitConstants(std::string& out) const;
+        void EmitFunction(uint32_t index, std::string& out) const;
+    };
+}
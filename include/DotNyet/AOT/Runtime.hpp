@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <DotNyet/Types/Value.hpp>
+#include <DotNyet/VM/Stack.hpp>
+#include <DotNyet/VM/OutputChannel.hpp>
+#include <DotNyet/VM/InputChannel.hpp>
+
+namespace DotNyet::AOT {
+    using Types::Value;
+
+    // What programs translated by CppEmitter run against. Translated functions
+    // keep their operands in C++ variables; the stack only carries values
+    // across CALL and RET, the way the interpreter's operand stack does.
+    struct Runtime {
+        VM::Stack stack;
+        VM::OutputChannel output;
+        VM::InputChannel input;
+    };
+
+    using Entry = void (*)(Runtime& rt);
+
+    // Ends the program, as HALT and running off the end of the code do
+    [[noreturn]] void Finish();
+
+    // ADD into `lhs`, appending in place when both operands are strings
+    inline void AddTo(Value& lhs, const Value& rhs) {
+        if (lhs.IsString() && rhs.IsString())
+            lhs.Append(rhs.AsString());
+        else
+            lhs = lhs + rhs;
+    }
+
+    // Int arithmetic for operands proven to be ints. Overflow wraps around.
+    inline int64_t IntAdd(int64_t a, int64_t b) {
+        return static_cast<int64_t>(static_cast<uint64_t>(a) + static_cast<uint64_t>(b));
+    }
+
+    inline int64_t IntSub(int64_t a, int64_t b) {
+        return static_cast<int64_t>(static_cast<uint64_t>(a) - static_cast<uint64_t>(b));
+    }
+
+    inline int64_t IntMul(int64_t a, int64_t b) {
+        return static_cast<int64_t>(static_cast<uint64_t>(a) * static_cast<uint64_t>(b));
+    }
+
+    // Throws on division by zero like Types::operator/
+    int64_t IntDiv(int64_t a, int64_t b);
+
+    // Runs a translated program: `main` gets the command line arguments
+    // (after an optional "--") joined by spaces as its argument, as with
+    // dotnyet. Returns the process exit code.
+    int Main(int argc, char* argv[], Entry main);
+}
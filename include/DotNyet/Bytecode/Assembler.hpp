@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <Util/Log.hpp>
+
+namespace DotNyet::Bytecode {
+    // Compiles .ny assembly source to a version 2 .nyet file, byte for byte
+    // what tools/dotnyet.py writes for the same source.
+    //
+    // One pass over the source: the lexer hands out one token at a time as a
+    // view into the source, statements are emitted as soon as they are
+    // parsed, and jumps to labels not seen yet go into a fixup table that is
+    // patched at the end. Compared to the Python tool, a function without a
+    // `return` and an unterminated string are errors instead of a hang or a
+    // silently truncated program, and non-ASCII characters in strings are
+    // kept as they are instead of being encoded twice.
+    class Assembler {
+    public:
+        explicit Assembler(std::string_view source);
+
+        // Throws Core::AssemblerException describing the first error found
+        std::vector<uint8_t> Assemble();
+
+    private:
+        enum class TokenType : uint8_t {
+            End,
+            Identifier,
+            Number,
+            String,
+            Keyword,
+            Symbol,
+            Newline,
+        };
+
+        struct Token {
+            TokenType type = TokenType::End;
+            std::string_view text; // strings without their quotes
+            uint32_t line = 0;
+        };
+
+        // The operand of push, return, `=` or a call. Identifiers and strings
+        // are the same thing here: either names a variable if one is in scope.
+        struct Operand {
+            enum class Kind : uint8_t { String, Integer, Double } kind = Kind::String;
+            std::string_view text;
+            std::string decoded; // used instead of `text` for strings with escapes
+            bool escaped = false;
+            int64_t integer = 0;
+            double number = 0.0;
+
+            std::string_view Text() const {
+                return escaped ? std::string_view(decoded) : text;
+            }
+        };
+
+        using Scope = std::unordered_map<std::string_view, uint32_t>;
+
+        struct Fixup {
+            size_t at;
+            std::string_view label;
+        };
+
+        std::string_view source;
+        size_t pos = 0;
+        uint32_t line = 1;
+        Token peeked;
+        bool hasPeeked = false;
+
+        std::vector<uint8_t> code;
+        std::string constants; // encoded pool entries
+        uint32_t constantCount = 0;
+        std::unordered_map<std::string, uint32_t> constantIndex; // encoding -> index
+        std::unordered_map<std::string_view, size_t> labels;      // name -> code offset
+        std::vector<Fixup> fixups;
+
+        // Name resolution mirrors dotnyet.py, quirks included: parameters
+        // shadow locals, and each function scope starts counting slots after
+        // the parameters of the function it is in
+        std::vector<std::string_view> params;
+        std::vector<std::vector<std::string_view>> paramStack;
+        Scope topLevel;
+        std::vector<Scope> scopes;
+        Scope* locals;
+        uint32_t localCount = 0;
+
+        Util::Logger logger;
+
+        Token Next();
+        Token Peek();
+        Token Lex();
+        Token Expect(TokenType type, const char* what);
+        void ExpectSymbol(char symbol);
+
+        void Statement(const Token& token);
+        void Function();
+        Operand Value();
+        void DecodeString(const Token& token, Operand& operand) const;
+
+        void EmitByte(uint8_t byte);
+        void EmitUInt32(uint32_t value);
+        void EmitValue(const Operand& operand);
+        void EmitStore(const Token& name);
+        uint32_t Constant(const Operand& operand);
+        uint32_t NameConstant(std::string_view name);
+        bool FindVariable(std::string_view name, uint32_t& slot) const;
+        [[noreturn]] void Fail(const std::string& message) const;
+    };
+
+    // Whether `path` names .ny source rather than bytecode
+    bool IsSourcePath(std::string_view path);
+    // Assembles the .ny file at `path`, memory-mapped where possible
+    std::vector<uint8_t> AssembleFile(const std::string& path);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <span>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <DotNyet/Bytecode/Instruction.hpp>
+#include <Util/Log.hpp>
+
+namespace DotNyet::Bytecode {
+    // A whole .nyet file: the bytecode after its header and the format
+    // version the header names
+    struct Image {
+        std::span<const uint8_t> bytecode;
+        uint8_t version;
+        // Files without the NYET magic predate the header; they are read as
+        // version 1 code from their first byte
+        bool hasHeader;
+    };
+
+    // Splits `file` into header and bytecode. Throws
+    // Core::BytecodeFormatException for a truncated header or an unsupported version.
+    Image ReadImage(std::span<const uint8_t> file);
+
+    // Turns a raw bytecode stream (without the NYET header) of the given
+    // format version into a Program.
+    // All operands are read and bounds-checked exactly once, and jump targets
+    // are translated from byte offsets into instruction indices.
+    // String constants are not copied: they point into `bytecode`, so whoever
+    // owns those bytes has to keep them alive as long as the Program (see
+    // Program::storage). Equal string constants share one StringObject.
+    class Decoder {
+    public:
+        Decoder(std::span<const uint8_t> bytecode, uint8_t version);
+
+        Program Decode();
+
+    private:
+        std::span<const uint8_t> bytecode;
+        uint8_t version;
+        // String constants seen so far -> index into Program::constants
+        std::unordered_map<std::string_view, uint32_t> strings;
+        Util::Logger logger;
+
+        // Reads a ValueTypeTag and its payload, advancing `pos`
+        Types::Value ReadConstant(size_t& pos) const;
+        uint32_t AddConstant(Program& program, Types::Value constant);
+
+        uint8_t ReadUInt8(size_t pos) const;
+        int64_t ReadInt64(size_t pos) const;
+        uint32_t ReadUInt32(size_t pos) const;
+        double ReadDouble(size_t pos) const;
+        std::string_view ReadString(size_t pos, size_t len) const;
+    };
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <DotNyet/Bytecode/Instruction.hpp>
+#include <Util/Log.hpp>
+
+namespace DotNyet::Bytecode {
+    // Rewrites the fixed idioms of compiled .ny code into superinstructions
+    // that the interpreter executes in a single dispatch.
+    //
+    // Only the first instruction of a sequence is replaced. The others stay in
+    // place: the superinstruction reads their operands and skips over them,
+    // so no instruction index changes and every jump target stays valid. A
+    // sequence is left alone if a jump or a function entry lands inside it.
+    // TAIL_CALL is the exception: it never comes back to the instructions
+    // after it, so it is formed even if other code jumps to them.
+    class Fuser {
+    public:
+        // How often each superinstruction was formed
+        struct Counts {
+            size_t addLocalConst = 0;
+            size_t cmpJnzLocals = 0;
+            size_t cmpJnzLocalConst = 0;
+            size_t loadConstStore = 0;
+            size_t inputInt = 0;
+            size_t tailCall = 0;
+
+            size_t Total() const {
+                return addLocalConst + cmpJnzLocals + cmpJnzLocalConst + loadConstStore + inputInt + tailCall;
+            }
+        };
+
+        explicit Fuser(Program& program);
+
+        Counts Fuse();
+
+    private:
+        Program& program;
+        Util::Logger logger;
+    };
+}
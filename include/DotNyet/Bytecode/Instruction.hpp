@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <DotNyet/Bytecode/Opcodes.hpp>
+#include <DotNyet/Types/Value.hpp>
+
+namespace DotNyet::Bytecode {
+    // A single decoded instruction. The meaning of `operand` depends on the opcode:
+    //   PUSH             -> index into Program::constants
+    //   DEF, CALL        -> index into Program::functions
+    //   STORE, LOAD      -> local slot in the current call frame
+    //   JMP, JZ, JNZ     -> index into Program::code
+    // A superinstruction keeps the operand of the first instruction it replaced
+    // and reads the rest from the instructions that follow it (see Fuser).
+    struct Instruction {
+        Opcode op = Opcode::NOP;
+        uint32_t operand = 0;
+    };
+
+    // Lets maps keyed by std::string be searched with a std::string_view
+    struct StringHash {
+        using is_transparent = void;
+
+        size_t operator()(std::string_view str) const {
+            return std::hash<std::string_view>{}(str);
+        }
+    };
+
+    // A function found while decoding, running from its DEF to the next one
+    struct Function {
+        std::string name;
+        uint32_t entry = 0;      // index of the first instruction after DEF
+        uint32_t localCount = 0; // highest STORE/LOAD slot in the body + 1
+        uint32_t arguments = 0;  // values the body may pop off its caller's stack (set by the Verifier)
+        bool returns = false;    // whether any RET is reachable (set by the Verifier)
+        int32_t effect = 0;      // net change of the caller's stack depth once it returns (set by the Verifier)
+    };
+
+    // The result of decoding a raw bytecode stream once at load time.
+    struct Program {
+        // Owner of the raw bytecode that string constants borrow from. Declared
+        // first so it is released only after everything pointing into it.
+        std::shared_ptr<const void> storage;
+        std::vector<Instruction> code;
+        std::vector<Types::Value> constants;
+        std::vector<Function> functions;
+        // Function name -> index into `functions`
+        std::unordered_map<std::string, uint32_t, StringHash, std::equal_to<>> functionTable;
+        // Set once the Verifier has accepted the program
+        bool verified = false;
+    };
+}
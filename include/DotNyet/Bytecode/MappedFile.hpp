@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace DotNyet::Bytecode {
+    // Read-only view of a whole bytecode file. On POSIX systems the file is
+    // memory-mapped, so loading does not copy it and the pages are shared
+    // between all processes running the same file. Elsewhere it is read into
+    // a private buffer instead.
+    class MappedFile {
+    public:
+        // Throws Core::BytecodeFormatException if the file cannot be opened
+        explicit MappedFile(const std::string& path);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        std::span<const uint8_t> Bytes() const {
+            return {data, size};
+        }
+
+    private:
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+#if defined(_WIN32)
+        std::vector<uint8_t> buffer;
+#endif
+    };
+}
@@ -3,6 +3,10 @@
 #include <cstdint>
 
 namespace DotNyet::Bytecode {
+    // Versions of the .nyet format, stored in the byte after the NYET magic
+    constexpr uint8_t FormatVersion1 = 0x01; // operands inline at every instruction
+    constexpr uint8_t FormatVersion2 = 0x02; // constant pool, PUSH/DEF/CALL by index
+
     enum class Opcode : uint8_t {
         // Stack manipulation opcodes
         NOP    = 0x00,
@@ -40,8 +44,66 @@ namespace DotNyet::Bytecode {
         // Misc
         TOINT  = 0x70,
         SUBSTR = 0x71,
+
+        // Superinstructions. These are produced at load time by Bytecode::Fuser
+        // and are never valid in a bytecode file.
+        ADD_LOCAL_CONST     = 0x80, // LOAD x; PUSH k; ADD; STORE x
+        CMP_JNZ_LOCALS      = 0x81, // LOAD a; LOAD b; CMP; JNZ L
+        CMP_JNZ_LOCAL_CONST = 0x82, // LOAD a; PUSH k; CMP; JNZ L
+        LOAD_CONST_STORE    = 0x83, // PUSH k; STORE x
+        INPUT_INT           = 0x84, // INPUT; TOINT
+        TAIL_CALL           = 0x85, // CALL f; [STORE r; LOAD r;] RET (reuses the caller's frame)
+
+        // Quickened forms. The interpreter rewrites ADD, SUB, MUL, DIV, CMP, JZ
+        // and JNZ into these in place once it has seen their operand types,
+        // and back to the generic opcode when the types change. Like the
+        // superinstructions they are never valid in a bytecode file.
+        ADD_II     = 0x90, // ADD on two ints
+        ADD_DD     = 0x91, // ADD on two doubles
+        ADD_SS     = 0x92, // ADD on two strings
+        SUB_II     = 0x93,
+        MUL_II     = 0x94,
+        MUL_DD     = 0x95,
+        DIV_II     = 0x96,
+        DIV_DD     = 0x97,
+        CMP_II     = 0x98,
+        CMP_SS     = 0x99,
+        CMP_II_JZ  = 0x9A, // CMP on two ints; JZ L (skips the JZ)
+        CMP_II_JNZ = 0x9B, // CMP on two ints; JNZ L (skips the JNZ)
+        JZ_B       = 0x9C, // JZ on a bool
+        JNZ_B      = 0x9D, // JNZ on a bool
     };
 
+    // The opcode a quickened form was rewritten from; any other opcode is
+    // returned unchanged
+    constexpr Opcode Generic(Opcode op) {
+        switch (op) {
+        case Opcode::ADD_II:
+        case Opcode::ADD_DD:
+        case Opcode::ADD_SS:
+            return Opcode::ADD;
+        case Opcode::SUB_II:
+            return Opcode::SUB;
+        case Opcode::MUL_II:
+        case Opcode::MUL_DD:
+            return Opcode::MUL;
+        case Opcode::DIV_II:
+        case Opcode::DIV_DD:
+            return Opcode::DIV;
+        case Opcode::CMP_II:
+        case Opcode::CMP_SS:
+        case Opcode::CMP_II_JZ:
+        case Opcode::CMP_II_JNZ:
+            return Opcode::CMP;
+        case Opcode::JZ_B:
+            return Opcode::JZ;
+        case Opcode::JNZ_B:
+            return Opcode::JNZ;
+        default:
+            return op;
+        }
+    }
+
     enum class ValueTypeTag : uint8_t {
         Null = 0,
         Integer = 1,
@@ -49,4 +111,52 @@ namespace DotNyet::Bytecode {
         Boolean = 3,
         String = 4,
     };
+
+    // Mnemonic of an opcode, for listings and reports
+    constexpr const char* Name(Opcode op) {
+        switch (op) {
+        case Opcode::NOP: return "NOP";
+        case Opcode::PUSH: return "PUSH";
+        case Opcode::POP: return "POP";
+        case Opcode::CMP: return "CMP";
+        case Opcode::DEF: return "DEF";
+        case Opcode::CALL: return "CALL";
+        case Opcode::RET: return "RET";
+        case Opcode::STORE: return "STORE";
+        case Opcode::LOAD: return "LOAD";
+        case Opcode::JMP: return "JMP";
+        case Opcode::JZ: return "JZ";
+        case Opcode::JNZ: return "JNZ";
+        case Opcode::HALT: return "HALT";
+        case Opcode::PRINT: return "PRINT";
+        case Opcode::INPUT: return "INPUT";
+        case Opcode::ADD: return "ADD";
+        case Opcode::SUB: return "SUB";
+        case Opcode::MUL: return "MUL";
+        case Opcode::DIV: return "DIV";
+        case Opcode::TOINT: return "TOINT";
+        case Opcode::SUBSTR: return "SUBSTR";
+        case Opcode::ADD_LOCAL_CONST: return "ADD_LOCAL_CONST";
+        case Opcode::CMP_JNZ_LOCALS: return "CMP_JNZ_LOCALS";
+        case Opcode::CMP_JNZ_LOCAL_CONST: return "CMP_JNZ_LOCAL_CONST";
+        case Opcode::LOAD_CONST_STORE: return "LOAD_CONST_STORE";
+        case Opcode::INPUT_INT: return "INPUT_INT";
+        case Opcode::TAIL_CALL: return "TAIL_CALL";
+        case Opcode::ADD_II: return "ADD_II";
+        case Opcode::ADD_DD: return "ADD_DD";
+        case Opcode::ADD_SS: return "ADD_SS";
+        case Opcode::SUB_II: return "SUB_II";
+        case Opcode::MUL_II: return "MUL_II";
+        case Opcode::MUL_DD: return "MUL_DD";
+        case Opcode::DIV_II: return "DIV_II";
+        case Opcode::DIV_DD: return "DIV_DD";
+        case Opcode::CMP_II: return "CMP_II";
+        case Opcode::CMP_SS: return "CMP_SS";
+        case Opcode::CMP_II_JZ: return "CMP_II_JZ";
+        case Opcode::CMP_II_JNZ: return "CMP_II_JNZ";
+        case Opcode::JZ_B: return "JZ_B";
+        case Opcode::JNZ_B: return "JNZ_B";
+        default: return "?";
+        }
+    }
 }
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <DotNyet/Bytecode/Instruction.hpp>
+#include <Util/Log.hpp>
+
+namespace DotNyet::Bytecode {
+    // Shrinks a verified program without changing what it does. Each round
+    //   - threads jumps that land on a JMP, and replaces jumps to a RET or
+    //     HALT by a copy of it,
+    //   - turns a LOAD into a PUSH where every path stores the same constant
+    //     to the slot, and a STORE into a POP where nothing reads the slot
+    //     before it is stored again,
+    //   - evaluates arithmetic, CMP, TOINT and SUBSTR on constants and
+    //     resolves conditional jumps on them,
+    //   - drops pairs that cancel out (PUSH/LOAD then POP, LOAD x; STORE x,
+    //     and STORE x; LOAD x when x is not read again, which leaves the
+    //     value on the stack), NOPs, jumps to the next instruction and code
+    //     no function reaches,
+    // and then closes the gaps, renumbering jump targets and function entries.
+    // Rounds repeat until one changes nothing.
+    //
+    // Operations that would throw or overflow are left alone, so a program
+    // fails at run time exactly as it did before. New constants are appended
+    // to the pool. The function summaries the Verifier computed still hold.
+    class Optimizer {
+    public:
+        // What the optimizer did, summed over all rounds
+        struct Counts {
+            size_t before = 0;      // instructions before the first round
+            size_t after = 0;       // instructions after the last one
+            size_t rounds = 0;
+            size_t threaded = 0;    // jumps retargeted or replaced by the RET/HALT they land on
+            size_t propagated = 0;  // LOADs of a known constant turned into PUSH
+            size_t deadStores = 0;  // STOREs nothing reads turned into POP
+            size_t folded = 0;      // operations on constants evaluated ahead of time
+            size_t branches = 0;    // conditional jumps on constants resolved
+            size_t stackKept = 0;   // STORE x; LOAD x pairs dropped
+            size_t cancelled = 0;   // other pairs, NOPs and jumps to the next instruction dropped
+            size_t unreachable = 0; // instructions no function reaches dropped
+        };
+
+        explicit Optimizer(Program& program);
+
+        // Expects a program the Verifier has accepted; throws
+        // Core::RuntimeException for one it has not
+        Counts Optimize();
+
+    private:
+        // Facts about the slot an instruction reads or writes, merged over
+        // every function that reaches it
+        static constexpr uint32_t Unseen = UINT32_MAX;       // no function reached it
+        static constexpr uint32_t Varies = UINT32_MAX - 1;   // not the same constant on every path
+
+        // Functions whose blocks times slots exceed this are not searched for
+        // constants and dead stores, to bound the memory the analysis takes
+        static constexpr size_t MaxAnalysisCells = size_t{1} << 22;
+        // Rounds after which the optimizer stops even if the last one changed something
+        static constexpr size_t MaxRounds = 16;
+        // JMPs followed when threading a jump before giving up on a cycle
+        static constexpr int MaxHops = 16;
+
+        Program& program;
+        Counts counts;
+
+        std::vector<uint8_t> entered;  // jump targets and function entries, plus the end
+        std::vector<uint8_t> removed;  // dropped this round, gone after Compact()
+        std::vector<uint32_t> blockStart;
+        std::vector<uint32_t> blockOf; // instruction index -> index into `blockStart`
+        std::vector<uint8_t> reachable;
+        std::vector<uint32_t> known;   // LOAD -> constant index the slot always holds, or Unseen/Varies
+        std::vector<uint8_t> readLater; // STORE/LOAD -> whether its slot may be read again afterwards
+        // Blocks the function being analyzed reaches, and each block's index
+        // into `order` (Unseen for the others)
+        std::vector<uint32_t> order;
+        std::vector<uint32_t> position;
+        // Scratch space of Analyze(), kept between functions
+        std::vector<uint32_t> constantsIn; // per block in `order`, the constant of each slot
+        std::vector<uint8_t> seen;
+        std::vector<uint32_t> state;
+        std::vector<uint32_t> worklist;
+        std::vector<uint64_t> liveIn;      // per block in `order`, a bitset of the slots read later
+        std::vector<uint64_t> live;
+        // Pool entries by type and contents, for deduplicating new constants
+        std::unordered_map<std::string, uint32_t> constantIndex;
+
+        Util::Logger logger;
+
+        bool Round();
+        void ThreadJumps();
+        void FindBlocks();
+        void Analyze(const Function& function);
+        void Simplify();
+        bool Fold(uint32_t at);
+        void Compact();
+
+        uint32_t BlockEnd(uint32_t block) const;
+        template <typename Visit>
+        void ForEachSuccessor(uint32_t block, Visit&& visit) const;
+        uint32_t Next(uint32_t at) const;
+        void Remove(uint32_t at);
+        uint32_t AddConstant(Types::Value value);
+        static std::string ConstantKey(const Types::Value& value);
+    };
+}
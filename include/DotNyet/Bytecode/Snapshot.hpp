@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+#include <DotNyet/Bytecode/Instruction.hpp>
+#include <DotNyet/Types/Value.hpp>
+
+namespace DotNyet::Bytecode {
+    // Version of the snapshot layout, stored after the NYETSNAP magic
+    constexpr uint32_t SnapshotVersion = 1;
+
+    // A program as a VM had it loaded, with the values on its stack.
+    //
+    // A snapshot file holds the decoded, verified and fused instructions (in
+    // their quickened form if the VM had warmed up), the constants with equal
+    // strings stored once, and the functions with their resolved entries,
+    // frame sizes and verifier results, each section laid out at a fixed
+    // offset. Restoring one only copies the instructions and rebuilds the
+    // name lookup; string constants point into the file like they do for
+    // .nyet files.
+    //
+    // Snapshots are a cache for one build of the VM, not an exchange format:
+    // they are stored in host byte order and rejected if the opcode set of the
+    // build that wrote them differs. Their checksum catches damaged files, but
+    // the verification result they record is trusted, so only restore
+    // snapshots from a trusted source.
+    struct Snapshot {
+        Program program;
+        std::vector<Types::Value> stack; // bottom first
+    };
+
+    // Whether `file` starts with the snapshot magic
+    bool IsSnapshot(std::span<const uint8_t> file);
+
+    // Serializes `program` with `code` in place of its own instructions (the
+    // copy a VM runs, quickened so far) and `stack`. Throws
+    // Core::RuntimeException for stack values that cannot be stored.
+    std::vector<uint8_t> WriteSnapshot(const Program& program, std::span<const Instruction> code,
+                                       std::span<const Types::Value> stack);
+
+    // Restores a snapshot without copying its strings: `owner` must keep the
+    // bytes of `file` alive and becomes Program::storage. Throws
+    // Core::BytecodeFormatException for files that are damaged, truncated or
+    // written by a different build.
+    Snapshot ReadSnapshot(std::span<const uint8_t> file, std::shared_ptr<const void> owner);
+}
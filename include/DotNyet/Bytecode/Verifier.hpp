@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DotNyet/Bytecode/Instruction.hpp>
+#include <Util/Log.hpp>
+
+namespace DotNyet::Bytecode {
+    // Proves, once at load time, what the interpreter would otherwise check on
+    // every instruction:
+    //   - every STORE/LOAD slot lies inside the frame it runs in
+    //   - no LOAD can read a slot that is not stored to on every path before it
+    //   - every basic block is entered with the same stack depth on all paths
+    //   - the operand stack never underflows, as long as each function's
+    //     caller provides Function::arguments values, and every RET has a
+    //     return value to hand back
+    // Opcodes, jump targets and CALLs are already validated by the Decoder.
+    // A program that passes is marked verified and may run unchecked.
+    class Verifier {
+    public:
+        explicit Verifier(Program& program);
+
+        // Throws Core::VerificationException describing the first problem found
+        void Verify();
+
+    private:
+        // What a CALL needs to know about its callee
+        struct Summary {
+            int64_t arguments = 0; // values consumed from the caller's stack at most
+            bool returns = false;  // whether any RET is reachable
+            int64_t effect = 0;    // net change of the stack depth once it returns
+
+            bool operator==(const Summary&) const = default;
+        };
+
+        struct Block {
+            uint32_t start;
+            uint32_t end;
+        };
+
+        // Dataflow facts at the start of a block, relative to the function entry
+        struct BlockState {
+            bool reached = false;
+            int64_t depth = 0;
+            std::vector<uint64_t> assigned; // bitset of definitely stored slots
+        };
+
+        Program& program;
+        std::vector<Block> blocks;
+        std::vector<uint32_t> blockOf; // instruction index -> index into `blocks`
+        std::vector<Summary> summaries;
+        // Per-block facts of the function being analyzed. Shared by all
+        // functions so that each analysis only pays for the blocks it reaches.
+        std::vector<BlockState> states;
+        std::vector<uint32_t> reached; // blocks whose state the analysis set
+        Util::Logger logger;
+
+        void FindBlocks();
+        Summary Analyze(const Function& function);
+    };
+}
@@ -28,9 +28,27 @@ namespace DotNyet::VM::Core {
             : VMException("RuntimeException: " + msg) {}
     };
 
+    class StackOverflowException : public VMException {
+    public:
+        explicit StackOverflowException(const std::string& msg)
+            : VMException("StackOverflowException: " + msg) {}
+    };
+
     class BytecodeFormatException : public VMException {
     public:
         explicit BytecodeFormatException(const std::string& msg)
             : VMException("BytecodeFormatException: " + msg) {}
     };
+
+    class VerificationException : public VMException {
+    public:
+        explicit VerificationException(const std::string& msg)
+            : VMException("VerificationException: " + msg) {}
+    };
+
+    class AssemblerException : public VMException {
+    public:
+        explicit AssemblerException(const std::string& msg)
+            : VMException("AssemblerException: " + msg) {}
+    };
 }
@@ -0,0 +1,16 @@
+#pragma once
+
+// Everything an embedder needs to run .NYET bytecode with libdotnyet:
+//
+//   DotNyet::VM::VirtualMachine vm;
+//   vm.SetLogLevel(Util::Logger::Level::Error);
+//   vm.GetOutput().RedirectTo([](std::string_view text) { ... });
+//   vm.LoadImage(std::move(bytes));
+//   DotNyet::Types::Value result = vm.Run("arguments");
+//
+// Errors are reported as the exceptions of DotNyet/Core/Exceptions.hpp.
+
+#include <DotNyet/Core/Exceptions.hpp>
+#include <DotNyet/Types/Value.hpp>
+#include <DotNyet/VM/VirtualMachine.hpp>
+#include <DotNyet/VM/BatchRunner.hpp>
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace DotNyet::Types {
+    // Reference-counted string payload used by Value.
+    // The characters normally live inline right after the header, so creating a
+    // string costs a single allocation and copying a Value only bumps the count.
+    // A string is immutable while it is shared; Append() extends a string that
+    // has a single owner in place, growing its buffer geometrically, so building
+    // a string piece by piece takes linear time.
+    // Borrowed strings point at characters owned by someone else instead (e.g.
+    // constants in a memory-mapped bytecode file), which must outlive them.
+    // Reference counts are not atomic: a StringObject belongs to one VM, unless
+    // it is frozen. A frozen string ignores Retain() and Release(), so threads
+    // may copy it freely; whoever froze it keeps it alive and thaws it again.
+    class StringObject {
+    public:
+        // Set in the reference count of a frozen string
+        static constexpr uint32_t FrozenBit = 0x80000000u;
+
+        StringObject(const StringObject&) = delete;
+        StringObject& operator=(const StringObject&) = delete;
+
+        // Returns a new object with a reference count of one
+        static StringObject* Create(std::string_view text);
+        static StringObject* Concat(std::string_view lhs, std::string_view rhs);
+        // Refers to `text` in place without copying it
+        static StringObject* Borrow(std::string_view text);
+        // Consumes the caller's reference to `str` and returns a reference to
+        // `str` followed by `text`: `str` itself if it could be extended in place
+        static StringObject* Append(StringObject* str, std::string_view text);
+
+        void Retain() {
+            if (!(refs & FrozenBit))
+                refs++;
+        }
+
+        void Release() {
+            if (!(refs & FrozenBit) && --refs == 0)
+                Destroy(this);
+        }
+
+        uint32_t RefCount() const {
+            return refs & ~FrozenBit;
+        }
+
+        void Freeze() {
+            refs |= FrozenBit;
+        }
+
+        void Thaw() {
+            refs &= ~FrozenBit;
+        }
+
+        bool IsFrozen() const {
+            return refs & FrozenBit;
+        }
+
+        size_t Size() const {
+            return size;
+        }
+
+        const char* Data() const {
+            return data;
+        }
+
+        bool IsBorrowed() const {
+            return data != reinterpret_cast<const char*>(this + 1);
+        }
+
+        std::string_view View() const {
+            return std::string_view(Data(), size);
+        }
+
+    private:
+        uint32_t refs = 1;
+        size_t size = 0;
+        size_t capacity = 0; // inline bytes available, zero for borrowed strings
+        const char* data;
+
+        StringObject(size_t size, size_t capacity, const char* data) : size(size), capacity(capacity), data(data) {}
+
+        char* MutableData() {
+            return reinterpret_cast<char*>(this + 1);
+        }
+
+        static StringObject* Allocate(size_t size, size_t capacity);
+        static void Destroy(StringObject* str);
+    };
+}
@@ -1,24 +1,16 @@
 #pragma once
 
-#include <variant>
 #include <string>
+#include <string_view>
 #include <cstdint>
 #include <iostream>
+#include <utility>
 #include <fmt/core.h>
 #include <DotNyet/Core/Exceptions.hpp>
+#include <DotNyet/Types/String.hpp>
 
 namespace DotNyet::Types {
-    struct Value;
-
-    using ValueData = std::variant<
-        std::monostate,  // represents null/none
-        int64_t,         // Integer
-        double,          // Floating point
-        bool,            // Boolean
-        std::string      // String (UTF-8)
-    >;
-
-    enum class ValueType {
+    enum class ValueType : uint8_t {
         Null,
         Integer,
         Double,
@@ -27,36 +19,150 @@ namespace DotNyet::Types {
         Unknown
     };
 
+    // A 16-byte tagged value: a one byte type tag followed by an 8-byte payload.
+    // Strings are stored as a pointer to a reference-counted StringObject, so
+    // copying any Value never copies characters.
     struct Value {
-        ValueData data;
-
         Value() = default;
-        explicit Value(int64_t i);
-        explicit Value(double d);
-        explicit Value(bool b);
-        explicit Value(const std::string& s);
+        explicit Value(int64_t i) : type(ValueType::Integer) { as.i = i; }
+        explicit Value(double d) : type(ValueType::Double) { as.d = d; }
+        explicit Value(bool b) : type(ValueType::Boolean) { as.b = b; }
+        explicit Value(std::string_view s) : type(ValueType::String) { as.s = StringObject::Create(s); }
+        explicit Value(const std::string& s) : Value(std::string_view(s)) {}
+        explicit Value(const char* s) : Value(std::string_view(s)) {}
+
+        // Placeholder for a slot that has never been assigned; Type() is Unknown
+        static Value Uninitialized() {
+            Value v;
+            v.type = ValueType::Unknown;
+            return v;
+        }
 
-        ValueType Type() const;
+        // Takes over a reference the caller already owns
+        static Value FromString(StringObject* str) {
+            Value v;
+            v.type = ValueType::String;
+            v.as.s = str;
+            return v;
+        }
+
+        Value(const Value& other) : type(other.type), as(other.as) {
+            if (type == ValueType::String)
+                as.s->Retain();
+        }
+
+        Value(Value&& other) noexcept : type(other.type), as(other.as) {
+            other.type = ValueType::Null;
+        }
+
+        Value& operator=(const Value& other) {
+            if (other.type == ValueType::String)
+                other.as.s->Retain();
+            Reset();
+            type = other.type;
+            as = other.as;
+            return *this;
+        }
+
+        Value& operator=(Value&& other) noexcept {
+            if (this != &other) {
+                Reset();
+                type = other.type;
+                as = other.as;
+                other.type = ValueType::Null;
+            }
+            return *this;
+        }
+
+        ~Value() {
+            Reset();
+        }
+
+        ValueType Type() const { return type; }
 
         std::string ToString() const;
-        bool IsNull() const;
-        bool IsInt() const;
-        bool IsDouble() const;
-        bool IsBool() const;
-        bool IsString() const;
-
-        int64_t AsInt() const;
-        double AsDouble() const;
-        bool AsBool() const;
-        const std::string& AsString() const;
-        
+        bool IsNull() const { return type == ValueType::Null; }
+        bool IsInt() const { return type == ValueType::Integer; }
+        bool IsDouble() const { return type == ValueType::Double; }
+        bool IsBool() const { return type == ValueType::Boolean; }
+        bool IsString() const { return type == ValueType::String; }
+        bool IsUninitialized() const { return type == ValueType::Unknown; }
+
+        int64_t AsInt() const {
+            if (!IsInt()) ThrowTypeMismatch("Value is not an int");
+            return as.i;
+        }
+
+        double AsDouble() const {
+            if (!IsDouble()) ThrowTypeMismatch("Value is not a double");
+            return as.d;
+        }
+
+        bool AsBool() const {
+            if (!IsBool()) ThrowTypeMismatch("Value is not a bool");
+            return as.b;
+        }
+
+        // Payload access without the type check, for callers that have just
+        // checked the type themselves
+        int64_t IntUnchecked() const { return as.i; }
+        double DoubleUnchecked() const { return as.d; }
+        bool BoolUnchecked() const { return as.b; }
+
+        std::string_view AsString() const {
+            if (!IsString()) ThrowTypeMismatch("Value is not a string");
+            return as.s->View();
+        }
+
+        // The underlying string object, or nullptr if this is not a string
+        StringObject* AsStringObject() const {
+            return IsString() ? as.s : nullptr;
+        }
+
         bool IsTruthy() const;
+
+        // Appends to this string, in place if no other Value shares it
+        void Append(std::string_view text) {
+            if (!IsString()) ThrowTypeMismatch("Value is not a string");
+            as.s = StringObject::Append(as.s, text);
+        }
+
+    private:
+        ValueType type = ValueType::Null;
+        union Payload {
+            int64_t i;
+            double d;
+            bool b;
+            StringObject* s;
+        } as{0};
+
+        void Reset() {
+            if (type == ValueType::String)
+                as.s->Release();
+            type = ValueType::Null;
+        }
+
+        [[noreturn]] static void ThrowTypeMismatch(const char* msg);
     };
 
+    static_assert(sizeof(Value) == 16, "Value is expected to be a 16-byte tagged union");
+
     Value operator+(const Value& lhs, const Value& rhs);
     Value operator-(const Value& lhs, const Value& rhs);
     Value operator*(const Value& lhs, const Value& rhs);
     Value operator/(const Value& lhs, const Value& rhs);
+
+    // Equality as CMP defines it: both operands must have the same type
+    bool Equals(const Value& lhs, const Value& rhs);
+    // TOINT: ints as they are, doubles truncated and strings parsed
+    int64_t ToInt(const Value& value);
+    // String to int as TOINT defines it, matching std::stoll: leading
+    // whitespace and an optional sign, then decimal digits up to the first
+    // character that is not one. Independent of the locale.
+    int64_t ParseInt(std::string_view text);
+    // SUBSTR: the characters of `str` from index `start` up to `end`
+    Value Substr(const Value& str, const Value& start, const Value& end);
+
     std::ostream& operator<<(std::ostream& os, const Value& val);
 }
 
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <DotNyet/Bytecode/Instruction.hpp>
+#include <DotNyet/VM/VirtualMachine.hpp>
+
+namespace DotNyet::VM {
+    // Runs one program made by VirtualMachine::Prepare() over many inputs in
+    // parallel.
+    //
+    // Every worker thread has a VirtualMachine of its own that loads the shared
+    // program once, so quickened and compiled code carry over from one job to
+    // the next. Each job runs 'main' on a fresh stack with no frames left
+    // over, reads its input through INPUT and prints into a buffer of its own.
+    // Jobs are dealt out in contiguous ranges, one per worker; a worker that
+    // runs out steals the back half of what another has left, so a few slow
+    // jobs do not leave the other cores idle.
+    class BatchRunner {
+    public:
+        struct Result {
+            std::string output;       // everything the job printed
+            std::exception_ptr error; // what the job failed with, if it did
+        };
+
+        // Called with the VM of every worker before it runs anything
+        using Setup = std::function<void(VirtualMachine&)>;
+        // Called once per job, in job order and never concurrently, as soon as
+        // the job and all jobs before it are done
+        using Emit = std::function<void(size_t job, Result& result)>;
+
+        // `threads` of 0 uses one per hardware thread
+        explicit BatchRunner(std::shared_ptr<const Bytecode::Program> program, unsigned threads = 0);
+
+        // Configures the VMs, e.g. to enable the JIT or set their log level
+        void SetSetup(Setup setup);
+        // The argument string 'main' gets in every job (empty by default)
+        void SetArguments(std::string arguments);
+        unsigned GetThreads() const;
+
+        // Runs 'main' once per entry of `inputs`, which INPUT reads; returns
+        // how many jobs failed
+        size_t Run(const std::vector<std::string>& inputs, const Emit& emit);
+
+    private:
+        std::shared_ptr<const Bytecode::Program> program;
+        unsigned threads;
+        Setup setup;
+        std::string arguments;
+    };
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <DotNyet/Types/Value.hpp>
+
+namespace DotNyet::VM {
+    // The frames of the active calls and the local slots each one owns.
+    //
+    // Frames and slots live in fixed-size chunks that are allocated the first
+    // time the calls get that deep and kept for later runs. Pushing a frame
+    // therefore never moves or copies the frames and slots below it, and
+    // pointers to them stay valid until their frame is popped. Slots that no
+    // frame owns are always Uninitialized, which is how a new frame finds them.
+    class CallStack {
+    public:
+        // One activation of a function
+        struct Frame {
+            size_t returnIp;
+            Types::Value* slots;
+            uint32_t size;     // number of `slots`
+            uint32_t function; // index into Program::functions
+            uint32_t chunk;    // slot chunk `slots` lies in
+        };
+
+        CallStack() = default;
+
+        CallStack(const CallStack&) = delete;
+        CallStack& operator=(const CallStack&) = delete;
+
+        size_t Depth() const {
+            return depth;
+        }
+        bool Empty() const {
+            return depth == 0;
+        }
+        // The innermost frame; the stack must not be empty
+        Frame& Top() {
+            return *top;
+        }
+
+        Frame& Push(size_t returnIp, uint32_t function, uint32_t size);
+        // Drops the innermost frame and returns its return address
+        size_t Pop();
+        // Hands the innermost frame to `function` with `size` fresh slots,
+        // keeping its return address
+        Frame& Replace(uint32_t function, uint32_t size);
+        void Clear();
+
+    private:
+        static constexpr size_t FramesPerChunk = 256;
+        // Frames with more slots get a chunk of their own size
+        static constexpr uint32_t SlotsPerChunk = 1024;
+
+        struct SlotChunk {
+            std::unique_ptr<Types::Value[]> values;
+            uint32_t capacity = 0;
+            uint32_t used = 0;
+        };
+
+        std::vector<std::unique_ptr<Frame[]>> frames;
+        std::vector<SlotChunk> slots;
+        size_t depth = 0;
+        Frame* top = nullptr;
+
+        // Takes `size` slots from chunk `chunk` or the first later one with room
+        Types::Value* Allocate(uint32_t size, uint32_t& chunk);
+        void Release(const Frame& frame);
+    };
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string_view>
+
+namespace DotNyet::VM {
+    // Buffered source of INPUT.
+    //
+    // Reads standard input (or another descriptor, or a callback) in large
+    // blocks and hands out lines as views into its buffer, so reading a line
+    // does not allocate. Because it reads ahead, nothing else should consume
+    // the same descriptor while a VM uses it.
+    class InputChannel {
+    public:
+        // Fills up to `size` bytes of `buffer`; returns 0 at the end of input
+        using Source = std::function<size_t(char* buffer, size_t size)>;
+
+        static constexpr size_t BlockSize = 64 * 1024;
+
+        InputChannel();
+        ~InputChannel();
+
+        InputChannel(const InputChannel&) = delete;
+        InputChannel& operator=(const InputChannel&) = delete;
+
+        // Reads from `fd` from now on, dropping anything buffered. The
+        // descriptor is not closed by the channel.
+        void RedirectTo(int fd);
+        // Reads from `source` from now on, dropping anything buffered
+        void RedirectTo(Source source);
+
+        // The next line without its '\n', like std::getline. At the end of
+        // input this is the empty string. The view stays valid until the
+        // next call.
+        std::string_view ReadLine();
+
+    private:
+        std::unique_ptr<char[]> buffer;
+        size_t capacity = BlockSize;
+        size_t start = 0; // first unread byte
+        size_t end = 0;   // one past the last buffered byte
+        bool exhausted = false;
+        int fd = 0;
+        Source source;
+
+        // Reads more input after the buffered bytes; false at the end of input
+        bool Fill();
+        void Reset();
+    };
+}
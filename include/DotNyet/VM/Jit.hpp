@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <DotNyet/Bytecode/Instruction.hpp>
+#include <DotNyet/Types/Value.hpp>
+#include <Util/Log.hpp>
+
+namespace DotNyet::VM {
+    // Baseline compiler from bytecode functions to x86-64 machine code.
+    //
+    // A function (the instructions from its DEF to the next one, as found by
+    // the Decoder) is compiled on its own once it has been called or has taken
+    // a backward jump `threshold` times. Compiled code works directly on the
+    // VM's operand stack and locals, with inline paths for ints and doubles
+    // only. A type guard that fails, and every instruction without an inline
+    // path (CALL, RET, PRINT, string operations, ...), hands control back to
+    // the interpreter at that instruction with all state in place. The
+    // interpreter enters compiled code again at function entries, backward
+    // jumps and returns, unless the code keeps handing control back after a
+    // few instructions.
+    //
+    // Compiled code performs no stack or frame checks, so only verified
+    // programs may be compiled. Code generation is only built on x86-64 Linux
+    // with DOTNYET_JIT; elsewhere no function is ever compiled.
+    class Jit {
+    public:
+        static constexpr uint32_t DefaultThreshold = 1000;
+
+        // What compiled code reads and updates, handed over on every entry
+        struct State {
+            Types::Value* top;   // one past the topmost operand
+            Types::Value* frame; // locals of the running function
+            uint64_t executed;   // instructions run until returning
+        };
+
+        // Machine code for one function
+        class Code {
+        public:
+            Code(uint32_t start, uint32_t end);
+            ~Code();
+
+            Code(const Code&) = delete;
+            Code& operator=(const Code&) = delete;
+
+            // Native address to enter at for instruction `ip`, or nullptr if
+            // the code cannot be entered there
+            const void* EntryAt(size_t ip) const {
+                return ip >= start && ip < end && !abandoned ? entries[ip - start] : nullptr;
+            }
+
+            // Most values the code may push beyond the stack it was entered with
+            size_t MaxGrowth() const {
+                return maxGrowth;
+            }
+
+            // Runs from `entry` until control returns to the interpreter and
+            // returns the instruction to continue at
+            uint32_t Run(State& state, const void* entry) const {
+                uint64_t before = state.executed;
+                uint32_t ip = function(&state, entry);
+                // Code that keeps handing control back almost at once costs
+                // more than it saves, so stop entering it
+                if (state.executed - before < MinUsefulRun) {
+                    if (++shortRuns == MaxShortRuns)
+                        abandoned = true;
+                } else {
+                    shortRuns = 0;
+                }
+                return ip;
+            }
+
+        private:
+            friend class Jit;
+            using Function = uint32_t (*)(State* state, const void* entry);
+
+            static constexpr uint64_t MinUsefulRun = 8;
+            static constexpr uint32_t MaxShortRuns = 64;
+
+            uint32_t start;
+            uint32_t end;
+            size_t maxGrowth = 0;
+            std::vector<const void*> entries;
+            void* memory = nullptr;
+            size_t mapped = 0;
+            Function function = nullptr;
+            mutable uint32_t shortRuns = 0;
+            mutable bool abandoned = false;
+        };
+
+        Jit(const Bytecode::Program& program, uint32_t threshold);
+        ~Jit();
+
+        // Whether this build can generate machine code
+        static bool IsAvailable();
+
+        // Counts a call or backward jump in `function`. Returns its code once
+        // it has been compiled, nullptr until then.
+        const Code* Tick(uint32_t function) {
+            auto& slot = functions[function];
+            if (slot.code)
+                return slot.code.get();
+            if (slot.failed || ++slot.count < threshold)
+                return nullptr;
+            return Compile(function);
+        }
+
+        // Compiled code of `function`, if there is any yet
+        const Code* Find(uint32_t function) const {
+            return functions[function].code.get();
+        }
+
+        size_t CompiledFunctions() const {
+            return compiled;
+        }
+
+    private:
+        struct Slot {
+            std::unique_ptr<Code> code;
+            uint32_t count = 0;
+            bool failed = false;
+        };
+
+        const Bytecode::Program& program;
+        uint32_t threshold;
+        std::vector<Slot> functions;
+        size_t compiled = 0;
+        Util::Logger logger;
+
+        const Code* Compile(uint32_t function);
+    };
+}
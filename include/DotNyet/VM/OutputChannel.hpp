@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <DotNyet/Types/Value.hpp>
+
+namespace DotNyet::VM {
+    // Buffered destination of PRINT.
+    //
+    // Output collects in a large user-space buffer and is written out once
+    // the buffer fills up, before the VM reads input (so prompts show up),
+    // when execution ends, normally or by an exception, and on destruction.
+    // By default it goes to standard output; it can be redirected to any file
+    // descriptor or handed to a callback for embedders that keep it in memory.
+    class OutputChannel {
+    public:
+        // Receives every flushed chunk of output
+        using Sink = std::function<void(std::string_view)>;
+
+        static constexpr size_t DefaultThreshold = 64 * 1024;
+
+        OutputChannel();
+        ~OutputChannel();
+
+        OutputChannel(const OutputChannel&) = delete;
+        OutputChannel& operator=(const OutputChannel&) = delete;
+
+        // Flushes pending output, then sends everything after it to `fd`.
+        // The descriptor is not closed by the channel.
+        void RedirectTo(int fd);
+        // Flushes pending output, then hands everything after it to `sink`
+        void RedirectTo(Sink sink);
+
+        void Write(std::string_view text) {
+            buffer.append(text);
+            if (buffer.size() >= DefaultThreshold)
+                Flush();
+        }
+
+        // Formats `value` the way Value::ToString does, straight into the buffer
+        void Write(const Types::Value& value);
+
+        void Flush();
+
+    private:
+        std::string buffer;
+        int fd;
+        Sink sink;
+    };
+}
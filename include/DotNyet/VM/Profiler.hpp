@@ -0,0 +1,114 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <DotNyet/Bytecode/Instruction.hpp>
+#include <DotNyet/Bytecode/Opcodes.hpp>
+
+namespace DotNyet::VM {
+    // Collects where a program spends its time while the interpreter runs it.
+    //
+    // Every dispatched instruction is counted by opcode. The cost of single
+    // instructions is measured with the CPU's timestamp counter at randomly
+    // spaced samples (one in about 64 instructions), so per-opcode times are
+    // estimates: sampled cycles per instruction times the exact count. Calls
+    // and returns are timed exactly, which gives every function its inclusive
+    // and exclusive time and every distinct call stack its exclusive time.
+    // Taken backward jumps are counted by the instruction that jumps.
+    class Profiler {
+    public:
+        explicit Profiler(const Bytecode::Program& program);
+
+        // Called before each instruction the interpreter dispatches
+        void Count(Bytecode::Opcode op) {
+            opcodes[static_cast<uint8_t>(op)].count++;
+            if (--countdown == 0)
+                Sample(op);
+        }
+
+        // `function` was called / the innermost function returned
+        void Enter(uint32_t function);
+        void Leave();
+
+        // The instruction at `from` jumped backward to `to`
+        void BackEdge(size_t from, uint32_t to) {
+            auto& edge = backEdges[from];
+            edge.count++;
+            edge.target = to;
+        }
+
+        // Closes the functions still running, e.g. after HALT or an exception
+        void Finish();
+
+        // Human-readable tables of the hottest opcodes, functions and loops
+        std::string Summary() const;
+        // One line per call stack, "main;outer;inner <exclusive ns>", as
+        // expected by flamegraph.pl and compatible tools
+        std::string CollapsedStacks() const;
+
+        // Current value of the clock everything is measured with
+        static uint64_t Ticks();
+
+    private:
+        struct OpcodeStats {
+            uint64_t count = 0;
+            uint64_t samples = 0;
+            uint64_t sampledTicks = 0;
+        };
+
+        struct FunctionStats {
+            uint64_t calls = 0;
+            uint64_t inclusive = 0;
+            uint64_t exclusive = 0;
+            uint32_t active = 0; // activations on the stack, for recursion
+        };
+
+        // A distinct call stack: its innermost function and the stack it was called from
+        struct Node {
+            uint32_t function;
+            uint32_t parent;
+            uint64_t exclusive = 0;
+        };
+
+        struct Frame {
+            uint32_t function;
+            uint32_t node;
+            uint64_t start;
+            uint64_t children = 0; // ticks spent in callees
+        };
+
+        struct Edge {
+            uint64_t count = 0;
+            uint32_t target = 0;
+        };
+
+        const Bytecode::Program& program;
+        std::array<OpcodeStats, 256> opcodes{};
+        std::vector<FunctionStats> functions;
+        std::vector<Node> nodes;
+        std::unordered_map<uint64_t, uint32_t> children; // (parent node, function) -> node
+        std::vector<Frame> frames;
+        std::vector<Edge> backEdges;
+
+        uint32_t countdown;
+        uint32_t random = 0x9E3779B9u;
+        bool sampling = false;
+        Bytecode::Opcode sampledOp = Bytecode::Opcode::NOP;
+        uint64_t sampleStart = 0;
+        uint64_t sampleOverhead = 0; // ticks a sample of nothing measures
+
+        uint64_t startTicks;
+        uint64_t startNanos;
+        uint64_t endTicks = 0;
+        uint64_t endNanos = 0;
+
+        void Sample(Bytecode::Opcode op);
+        uint32_t NextInterval();
+        double NanosPerTick() const;
+        std::string FunctionAt(size_t ip) const;
+    };
+}
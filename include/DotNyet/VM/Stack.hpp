@@ -1,22 +1,122 @@
 #pragma once
 
-#include <vector>
+#include <cstddef>
+#include <new>
+#include <span>
+#include <utility>
 #include <DotNyet/Types/Value.hpp>
 #include <Util/Log.hpp>
 
 namespace DotNyet::VM {
+    // Operand stack of the VM.
+    //
+    // Push/Pop/Peek are checked and throw Core::StackException on underflow.
+    // Top/TakeTop/DropTop/ReplaceTop are unchecked: callers must first make sure
+    // the stack is deep enough, either with Require() or through the verifier.
+    //
+    // The values live in one contiguous buffer that compiled code (see Jit) may
+    // push to and pop from directly, after making room with Reserve().
     class Stack {
     public:
         Stack();
+        ~Stack();
+
+        Stack(const Stack&) = delete;
+        Stack& operator=(const Stack&) = delete;
+
+        void Push(const Types::Value& val) {
+            if (top == limit) {
+                // `val` may live on this stack
+                Types::Value copy(val);
+                Grow(1);
+                new (top++) Types::Value(std::move(copy));
+                return;
+            }
+            new (top++) Types::Value(val);
+        }
+
+        void Push(Types::Value&& val) {
+            Emplace(std::move(val));
+        }
+
+        template <typename... Args>
+        Types::Value& Emplace(Args&&... args) {
+            if (top == limit)
+                Grow(1);
+            return *new (top++) Types::Value(std::forward<Args>(args)...);
+        }
+
+        Types::Value Pop() {
+            if (top == base)
+                Underflow("Pop called on empty stack");
+            return TakeTop();
+        }
 
-        void Push(const Types::Value& val);
-        Types::Value Pop();
         const Types::Value& Peek(size_t depth = 0) const;
-        size_t Size() const;
+        size_t Size() const {
+            return static_cast<size_t>(top - base);
+        }
+
+        // Throws unless at least `count` values are on the stack
+        void Require(size_t count) const {
+            if (Size() < count)
+                Underflow("Not enough values on the stack");
+        }
+
+        // Unchecked access to the value `depth` entries below the top
+        Types::Value& Top(size_t depth = 0) {
+            return top[-1 - static_cast<ptrdiff_t>(depth)];
+        }
+
+        // Unchecked pop that moves the top value out
+        Types::Value TakeTop() {
+            --top;
+            Types::Value val = std::move(*top);
+            top->~Value();
+            return val;
+        }
+
+        // Unchecked removal of the top `count` values
+        void DropTop(size_t count = 1) {
+            for (size_t i = 0; i < count; i++)
+                (--top)->~Value();
+        }
+
+        // Unchecked: replaces the top `count` values with `result`
+        void ReplaceTop(size_t count, Types::Value&& result) {
+            Top(count - 1) = std::move(result);
+            DropTop(count - 1);
+        }
+
+        // Makes room for `count` more values without reallocating
+        void Reserve(size_t count) {
+            if (static_cast<size_t>(limit - top) < count)
+                Grow(count);
+        }
+
+        // One past the topmost value. Code that writes values past it itself
+        // must Reserve() room first and hand the new top back with SetEnd().
+        Types::Value* End() {
+            return top;
+        }
+
+        void SetEnd(Types::Value* end) {
+            top = end;
+        }
+
+        // Everything on the stack, bottom first
+        std::span<const Types::Value> Values() const {
+            return {base, top};
+        }
 
     private:
-        std::vector<Types::Value> stack;
+        Types::Value* base = nullptr;
+        Types::Value* top = nullptr;
+        Types::Value* limit = nullptr;
         Util::Logger logger;
+
+        void Grow(size_t count);
+        [[noreturn]] void Underflow(const char* msg) const;
     };
 
 }
@@ -2,36 +2,208 @@
 
 #include <vector>
 #include <unordered_map>
-#include <vector>
+#include <memory>
+#include <span>
 #include <cstdint>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <DotNyet/Types/Value.hpp>
 #include <DotNyet/VM/Stack.hpp>
+#include <DotNyet/VM/CallStack.hpp>
+#include <DotNyet/VM/OutputChannel.hpp>
+#include <DotNyet/VM/InputChannel.hpp>
+#include <DotNyet/VM/Jit.hpp>
+#include <DotNyet/VM/Profiler.hpp>
 #include <DotNyet/Bytecode/Opcodes.hpp>
+#include <DotNyet/Bytecode/Instruction.hpp>
+#include <DotNyet/Bytecode/Fuser.hpp>
+#include <DotNyet/Bytecode/Optimizer.hpp>
 #include <Util/Log.hpp>
 
 namespace DotNyet::VM {
+    // One interpreter instance with its own stacks, input, output and log
+    // level. Instances share no mutable state, so any number of them may run
+    // concurrently on different threads; a single instance must only be used
+    // by one thread at a time. Values (strings in particular) must not be
+    // shared between instances that run concurrently. A program made by
+    // Prepare() is immutable and may be loaded into any number of instances.
     class VirtualMachine {
     public:
+        // How the interpreter loop transfers control between opcode handlers.
+        // Threaded dispatch (computed goto) is only available when the build
+        // enables DOTNYET_THREADED_DISPATCH.
+        enum class DispatchMode {
+            Switch,
+            Threaded,
+        };
+
+        // Nested calls Run() allows by default
+        static constexpr uint32_t DefaultMaxCallDepth = 100000;
+
+        // What Prepare() did to a program
+        struct PrepareStats {
+            // std::nullopt if the optimizer did not run
+            std::optional<Bytecode::Optimizer::Counts> optimized;
+            // std::nullopt for snapshots, which are saved fused
+            std::optional<Bytecode::Fuser::Counts> fused;
+        };
+
         VirtualMachine();
 
-        void LoadBytecode(std::vector<uint8_t> bytecode);
+        // Decodes, verifies (if `verify`), optimizes (if also `optimize`, see
+        // Bytecode::Optimizer) and fuses `bytecode` into a program that any
+        // number of instances may Load() and run at the same time. Its string
+        // constants are frozen until the last reference goes away. If given,
+        // `stats` receives what the optimizer and the Fuser did.
+        static std::shared_ptr<const Bytecode::Program> Prepare(std::span<const uint8_t> bytecode,
+                                                                std::shared_ptr<const void> owner,
+                                                                uint8_t version = Bytecode::FormatVersion2,
+                                                                bool verify = true, bool optimize = true,
+                                                                PrepareStats* stats = nullptr);
+        // Like Prepare(), for a whole .nyet file or snapshot held in memory.
+        // The stack a snapshot holds is not restored, and a snapshot is not
+        // optimized again.
+        static std::shared_ptr<const Bytecode::Program> PrepareImage(std::span<const uint8_t> file,
+                                                                     std::shared_ptr<const void> owner,
+                                                                     bool verify = true, bool optimize = true,
+                                                                     PrepareStats* stats = nullptr);
+        // Runs `program` from now on. The instance quickens a copy of its code
+        // of its own, so the program itself is never written to.
+        void Load(std::shared_ptr<const Bytecode::Program> program);
+
+        // Decodes `bytecode` (everything after the NYET header) in the given
+        // format version without copying its string constants. `owner` must keep
+        // the bytes alive; the VM holds on to it while the program is loaded.
+        void LoadBytecode(std::span<const uint8_t> bytecode, std::shared_ptr<const void> owner,
+                          uint8_t version = Bytecode::FormatVersion2);
+        void LoadBytecode(std::vector<uint8_t> bytecode, uint8_t version = Bytecode::FormatVersion2);
+        // Loads a whole .nyet file held in memory, header included, or a
+        // snapshot (see LoadSnapshot). `owner` keeps the bytes alive like for
+        // LoadBytecode.
+        void LoadImage(std::span<const uint8_t> file, std::shared_ptr<const void> owner);
+        void LoadImage(std::vector<uint8_t> file);
+        // Assembles .ny source (see Bytecode::Assembler) and loads the result
+        void LoadSource(std::string_view source);
+        // Loads the .nyet file or snapshot at `path`, memory-mapped where
+        // possible, or assembles it first if it is a .ny source file
+        void LoadFile(const std::string& path);
+
+        // Writes a Bytecode::Snapshot of the loaded program, with the code as
+        // this instance has quickened it so far and the values on its stack.
+        // Compiled code, the call stack and the log level are not part of it.
+        std::vector<uint8_t> SaveSnapshot() const;
+        // Restores a snapshot written by SaveSnapshot(), stack included,
+        // without decoding or verifying the program again. Snapshots of
+        // unverified programs run with all runtime checks.
+        void LoadSnapshot(std::span<const uint8_t> file, std::shared_ptr<const void> owner);
+
+        // Runs 'main' on whatever the stack holds
         void Run();
+        // Runs 'main' with `arguments` as its argument string, on a fresh
+        // stack, and returns the value left on top of the stack: the return
+        // value of 'main', or null if nothing is left. A string result is a
+        // copy that shares nothing with the instance or its program.
+        Types::Value Run(std::string_view arguments);
+
+        // Whether LoadBytecode runs the Verifier (on by default). Verified
+        // programs run without per-instruction stack and frame checks; programs
+        // loaded without verification keep all runtime checks.
+        void SetVerification(bool enabled);
+        bool IsVerificationEnabled() const;
+        // Whether LoadBytecode runs the Optimizer on verified programs (on by
+        // default)
+        void SetOptimization(bool enabled);
+        bool IsOptimizationEnabled() const;
+        // What Prepare() did to the program LoadBytecode() loaded; empty after
+        // Load() and for snapshots
+        const PrepareStats& GetPrepareStats() const;
         Stack& GetStack();
+        // Where PRINT writes to; standard output unless redirected
+        OutputChannel& GetOutput();
+        // Where INPUT reads from; standard input unless redirected
+        InputChannel& GetInput();
+
+        void SetDispatchMode(DispatchMode mode);
+        DispatchMode GetDispatchMode() const;
+        static bool HasThreadedDispatch();
+
+        // Whether Run() compiles hot functions of verified programs to machine
+        // code (off by default). Only available in builds with DOTNYET_JIT.
+        void SetJit(bool enabled);
+        bool IsJitEnabled() const;
+        static bool HasJit();
+        // Calls plus backward jumps after which a function is compiled
+        void SetJitThreshold(uint32_t threshold);
+
+        // Whether the interpreter rewrites arithmetic, comparisons and
+        // conditional jumps into forms specialized for the operand types it
+        // sees (on by default). The rewritten code stays in place for later
+        // runs of the same program.
+        void SetQuickening(bool enabled);
+        bool IsQuickeningEnabled() const;
+
+        // Whether Run() records a Profiler of opcode costs, function times and
+        // hot loops (off by default). The JIT stays off while profiling.
+        void SetProfiling(bool enabled);
+        bool IsProfilingEnabled() const;
+        // The profile of the last Run(), or null if it was not profiled
+        const Profiler* GetProfiler() const;
+
+        // The level this instance logs at, on whichever thread it runs;
+        // std::nullopt (the default) follows Util::Logger::SetLogLevel
+        void SetLogLevel(std::optional<Util::Logger::Level> level);
+        std::optional<Util::Logger::Level> GetLogLevel() const;
+
+        // How many calls may be active at once, 'main' included; one more
+        // throws Core::StackOverflowException. Frames and their locals are
+        // allocated in chunks as calls first get deep enough to need them, so
+        // the limit costs nothing until it is used. A CALL directly followed by
+        // RET replaces the caller's frame instead of adding one, so tail calls
+        // never count.
+        void SetMaxCallDepth(uint32_t depth);
+        uint32_t GetMaxCallDepth() const;
+
+        // Total number of instructions executed by Run() so far
+        uint64_t GetExecutedInstructions() const;
 
     private:
-        std::vector<uint8_t> bytecode;
+        std::shared_ptr<const Bytecode::Program> program;
+        // The code of `program` as this instance runs it, quickened in place
+        std::vector<Bytecode::Instruction> instructions;
         size_t ip = 0;
         Stack stack;
-        std::vector<size_t> callStack;
-        std::unordered_map<std::string, size_t> functionTable;
-        std::unordered_map<uint32_t, Types::Value> memory;
+        OutputChannel output;
+        InputChannel input;
+        // Holds at most `maxCallDepth` frames
+        CallStack callStack;
+        uint32_t maxCallDepth = DefaultMaxCallDepth;
+        DispatchMode dispatchMode;
+        bool verify = true;
+        bool optimize = true;
+        PrepareStats prepareStats;
+        bool jitEnabled = false;
+        uint32_t jitThreshold = Jit::DefaultThreshold;
+        std::unique_ptr<Jit> jit;
+        bool quickening = true;
+        // How often the quickened form of each instruction has seen other
+        // operand types; at MaxQuickenMisses it stays generic
+        std::vector<uint8_t> quickenMisses;
+        bool profiling = false;
+        std::unique_ptr<Profiler> profiler;
+        uint64_t executed = 0;
+        std::optional<Util::Logger::Level> logLevel;
         Util::Logger logger;
 
-        int64_t ReadInt64(size_t pos) const;
-        uint32_t ReadUInt32(size_t pos) const;
-        std::string ReadString(size_t pos, size_t len) const;
+        static constexpr uint8_t MaxQuickenMisses = 4;
+
+        // Freezes the constants of `program` for as long as it is shared
+        static std::shared_ptr<const Bytecode::Program> Share(Bytecode::Program program);
 
-        void LoadFunctionTable();
+        template <bool Threaded, bool Checked, bool Profiled>
+        void Execute();
+        void PushFrame(const Bytecode::Function& function, size_t returnIp);
+        void RunCompiled(const Jit::Code* code, Types::Value* frame);
+        void Trace(size_t pos) const;
     };
-}
\ No newline at end of file
+}
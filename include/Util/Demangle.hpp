@@ -9,7 +9,7 @@
 #pragma comment(lib, "Dbghelp.lib")
 #endif
 
-std::string demangle(const char* mangledName) {
+inline std::string demangle(const char* mangledName) {
 #if defined(__GNUG__)
     int status = 0;
     std::unique_ptr<char, void(*)(void*)> res{
@@ -1,11 +1,39 @@
 #pragma once
+#include <atomic>
 #include <format>
-#include <iostream>
+#include <optional>
+#include <string>
 #include <string_view>
-#include <mutex>
 #include <chrono>
-#include <iomanip>
-#include <sstream>
+#include <ctime>
+#include <cstdio>
+#include <iterator>
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+// Lowest level that is compiled in at all (0 = Debug, 1 = Info, 2 = Warn, 3 = Error).
+// Log calls below it compile to nothing, including their arguments.
+#ifndef DOTNYET_LOG_MIN_LEVEL
+#define DOTNYET_LOG_MIN_LEVEL 0
+#endif
+
+// Logs through `logger` only if `level` is compiled in and currently enabled.
+// Unlike calling Logger::Log directly, the format arguments are not evaluated
+// otherwise, so these are safe to use on hot paths with expensive arguments.
+#define NYET_LOG(logger, level, ...)                                            \
+    do {                                                                        \
+        if constexpr (static_cast<int>(level) >= DOTNYET_LOG_MIN_LEVEL) {       \
+            if ((logger).IsEnabled(level))                                      \
+                (logger).Log(level, __VA_ARGS__);                               \
+        }                                                                       \
+    } while (0)
+
+#define NYET_LOG_DEBUG(logger, ...) NYET_LOG(logger, ::Util::Logger::Level::Debug, __VA_ARGS__)
+#define NYET_LOG_INFO(logger, ...)  NYET_LOG(logger, ::Util::Logger::Level::Info, __VA_ARGS__)
+#define NYET_LOG_WARN(logger, ...)  NYET_LOG(logger, ::Util::Logger::Level::Warn, __VA_ARGS__)
+#define NYET_LOG_ERROR(logger, ...) NYET_LOG(logger, ::Util::Logger::Level::Error, __VA_ARGS__)
 
 namespace Util {
     class Logger {
@@ -19,32 +47,83 @@ namespace Util {
 
         constexpr Logger(std::string_view scope) : scope(scope) {}
 
+        // Overrides the process-wide level for every logger on the calling
+        // thread while it exists. VirtualMachine installs one around its work
+        // so that each instance logs at its own level.
+        class ScopedLevel {
+        public:
+            explicit ScopedLevel(std::optional<Level> level) : previous(ThreadLevel()) {
+                if (level)
+                    ThreadLevel() = level;
+            }
+
+            ~ScopedLevel() {
+                ThreadLevel() = previous;
+            }
+
+            ScopedLevel(const ScopedLevel&) = delete;
+            ScopedLevel& operator=(const ScopedLevel&) = delete;
+
+        private:
+            std::optional<Level> previous;
+        };
+
+        // The level of threads without a ScopedLevel
         static void SetLogLevel(Level level) {
-            currentLevel = level;
+            currentLevel.store(level, std::memory_order_relaxed);
         }
 
+        // The level in effect on the calling thread
         static Level GetLogLevel() {
-            return currentLevel;
+            if (auto level = ThreadLevel())
+                return *level;
+            return currentLevel.load(std::memory_order_relaxed);
+        }
+
+        // Whether `level` is compiled into this build at all
+        static constexpr bool IsCompiledIn(Level level) {
+            return static_cast<int>(level) >= DOTNYET_LOG_MIN_LEVEL;
+        }
+
+        bool IsEnabled(Level level) const {
+            return IsCompiledIn(level) && level >= GetLogLevel();
+        }
+
+        // Writes out everything the calling thread has buffered so far
+        static void Flush() {
+            ThreadSink().Flush();
         }
 
         template<typename... Args>
         void Log(Level level, std::string_view fmt_str, Args&&... args) const {
-            if (level < currentLevel) return;
-
-            std::lock_guard lock(outputMutex);
-
-            std::string prefix = std::string(levelPrefix(level));
-            std::string message = std::vformat(std::string(fmt_str), std::make_format_args(args...));
-            std::string timeStr = getTimestamp();
-            std::string color = levelColor(level);
-            std::string resetColor = "\033[0m";
-
-            std::cerr << color
-                << "[" << timeStr << "] "
-                << "[" << prefix << "] "
-                << "[" << scope << "] "
-                << message
-                << resetColor << '\n';
+            if (!IsEnabled(level)) return;
+
+            // Every thread formats into its own buffer, so logging never takes a lock.
+            // Debug output is batched; anything more important is written out at once.
+            Sink& sink = ThreadSink();
+            std::string& buffer = sink.buffer;
+            size_t start = buffer.size();
+
+            buffer += levelColor(level);
+            buffer += '[';
+            appendTimestamp(buffer);
+            buffer += "] [";
+            buffer += levelPrefix(level);
+            buffer += "] [";
+            buffer += scope;
+            buffer += "] ";
+
+            try {
+                std::vformat_to(std::back_inserter(buffer), fmt_str, std::make_format_args(args...));
+            } catch (...) {
+                buffer.resize(start);
+                throw;
+            }
+
+            buffer += "\033[0m\n";
+
+            if (level > Level::Debug || buffer.size() >= FlushThreshold)
+                sink.Flush();
         }
 
         template<typename... Args>
@@ -68,9 +147,46 @@ namespace Util {
         }
 
     private:
+        static constexpr size_t FlushThreshold = 64 * 1024;
+
+        struct Sink {
+            std::string buffer;
+
+            ~Sink() {
+                Flush();
+            }
+
+            void Flush() {
+                if (buffer.empty()) return;
+#if defined(_WIN32)
+                std::fwrite(buffer.data(), 1, buffer.size(), stderr);
+                std::fflush(stderr);
+#else
+                const char* data = buffer.data();
+                size_t remaining = buffer.size();
+                while (remaining > 0) {
+                    ssize_t written = ::write(STDERR_FILENO, data, remaining);
+                    if (written <= 0) break;
+                    data += written;
+                    remaining -= static_cast<size_t>(written);
+                }
+#endif
+                buffer.clear();
+            }
+        };
+
         std::string_view scope;
-        inline static std::mutex outputMutex;
-        inline static Level currentLevel = Level::Debug;
+        inline static std::atomic<Level> currentLevel = Level::Debug;
+
+        static Sink& ThreadSink() {
+            thread_local Sink sink;
+            return sink;
+        }
+
+        static std::optional<Level>& ThreadLevel() {
+            thread_local std::optional<Level> level;
+            return level;
+        }
 
         static constexpr std::string_view levelPrefix(Level level) {
             switch (level) {
@@ -92,17 +208,33 @@ namespace Util {
             }
         }
 
-        static std::string getTimestamp() {
+        // Appends HH:MM:SS.mmm; the calendar conversion only runs once per second
+        static void appendTimestamp(std::string& out) {
             using namespace std::chrono;
 
+            thread_local std::time_t cachedSecond = -1;
+            thread_local char cachedTime[9] = {};
+
             auto now = system_clock::now();
             auto itt = system_clock::to_time_t(now);
-            auto ms = duration_cast<milliseconds>(now.time_since_epoch()) % 1000;
+            auto ms = duration_cast<milliseconds>(now.time_since_epoch()).count() % 1000;
+
+            if (itt != cachedSecond) {
+                std::tm tm{};
+#if defined(_WIN32)
+                localtime_s(&tm, &itt);
+#else
+                localtime_r(&itt, &tm);
+#endif
+                std::strftime(cachedTime, sizeof(cachedTime), "%H:%M:%S", &tm);
+                cachedSecond = itt;
+            }
 
-            std::ostringstream ss;
-            ss << std::put_time(std::localtime(&itt), "%H:%M:%S")
-                << '.' << std::setfill('0') << std::setw(3) << ms.count();
-            return ss.str();
+            out += cachedTime;
+            out += '.';
+            out += static_cast<char>('0' + ms / 100);
+            out += static_cast<char>('0' + ms / 10 % 10);
+            out += static_cast<char>('0' + ms % 10);
         }
     };
-}
\ No newline at end of file
+}
@@ -0,0 +1,675 @@
+#include <DotNyet/AOT/CppEmitter.hpp>
+#include <DotNyet/Core/Exceptions.hpp>
+#include <algorithm>
+#include <bit>
+#include <climits>
+#include <map>
+#include <set>
+#include <fmt/core.h>
+
+namespace DotNyet::AOT {
+
+    namespace {
+        using Bytecode::Opcode;
+        using Types::ValueType;
+
+        // A set of possible value types, one bit per ValueType
+        using TypeSet = uint8_t;
+
+        constexpr TypeSet Bit(ValueType type) {
+            return static_cast<TypeSet>(1u << static_cast<unsigned>(type));
+        }
+
+        constexpr TypeSet IntT = Bit(ValueType::Integer);
+        constexpr TypeSet DoubleT = Bit(ValueType::Double);
+        constexpr TypeSet BoolT = Bit(ValueType::Boolean);
+        constexpr TypeSet StringT = Bit(ValueType::String);
+        constexpr TypeSet AnyT = Bit(ValueType::Null) | IntT | DoubleT | BoolT | StringT;
+
+        bool IsNumber(ValueType type) {
+            return type == ValueType::Integer || type == ValueType::Double;
+        }
+
+        // Result types of a binary operation over every pair of operand types
+        // it accepts (see Types::operator+ and friends)
+        TypeSet Combine(Opcode op, TypeSet lhs, TypeSet rhs) {
+            TypeSet result = 0;
+            for (unsigned a = 0; a < 5; a++) {
+                for (unsigned b = 0; b < 5; b++) {
+                    if (!(lhs & (1u << a)) || !(rhs & (1u << b)))
+                        continue;
+                    auto ta = static_cast<ValueType>(a);
+                    auto tb = static_cast<ValueType>(b);
+                    bool ints = ta == ValueType::Integer && tb == ValueType::Integer;
+                    bool numbers = IsNumber(ta) && IsNumber(tb);
+
+                    switch (op) {
+                    case Opcode::ADD:
+                        if (ints)
+                            result |= IntT;
+                        else if (numbers)
+                            result |= DoubleT;
+                        else if ((ta == ValueType::String && (tb == ValueType::String || IsNumber(tb))) ||
+                                 (tb == ValueType::String && IsNumber(ta)))
+                            result |= StringT;
+                        break;
+                    case Opcode::SUB:
+                        if (ints)
+                            result |= IntT;
+                        break;
+                    default: // MUL, DIV
+                        if (ints)
+                            result |= IntT;
+                        else if (numbers)
+                            result |= DoubleT;
+                        break;
+                    }
+                }
+            }
+            return result;
+        }
+
+        // Types on the operand stack and in the locals before an instruction.
+        // Stack positions are relative to the function entry; the negative ones
+        // hold what the function takes from its caller.
+        struct State {
+            int32_t low = 0;             // position of stack[0]
+            std::vector<TypeSet> stack;  // top last
+            std::vector<TypeSet> locals; // empty until stored to
+
+            int32_t Depth() const {
+                return low + static_cast<int32_t>(stack.size());
+            }
+
+            TypeSet At(int32_t position) const {
+                return stack[position - low];
+            }
+
+            void Push(TypeSet types) {
+                stack.push_back(types);
+            }
+
+            TypeSet Pop() {
+                TypeSet types = stack.back();
+                stack.pop_back();
+                return types;
+            }
+
+            // Widens this state to cover `other` as well (the verifier already
+            // made sure both have the same depth); returns whether it changed
+            bool Merge(const State& other) {
+                bool changed = false;
+                for (size_t k = 0; k < stack.size(); k++) {
+                    TypeSet widened = stack[k] | other.stack[k];
+                    changed |= widened != stack[k];
+                    stack[k] = widened;
+                }
+                for (size_t x = 0; x < locals.size(); x++) {
+                    TypeSet widened = locals[x] | other.locals[x];
+                    changed |= widened != locals[x];
+                    locals[x] = widened;
+                }
+                return changed;
+            }
+        };
+
+        // Values known to be an int or a boolean live in int64_t variables
+        bool IsScalar(TypeSet types) {
+            return types == IntT || types == BoolT;
+        }
+
+
+        std::string IntLiteral(int64_t value) {
+            if (value == INT64_MIN)
+                return "INT64_MIN";
+            return fmt::format("int64_t{{{}}}", value);
+        }
+
+        // A C++ string literal; anything but printable ASCII is escaped in octal
+        std::string StringLiteral(std::string_view text) {
+            std::string literal = "\"";
+            for (unsigned char c : text) {
+                if (c == '"' || c == '\\') {
+                    literal += '\\';
+                    literal += static_cast<char>(c);
+                } else if (c >= 0x20 && c < 0x7F) {
+                    literal += static_cast<char>(c);
+                } else {
+                    literal += fmt::format("\\{:03o}", c);
+                }
+            }
+            return literal + "\"";
+        }
+
+
+        // Analyzes and translates one function.
+        //
+        // Every stack position and local has two C++ variables: an int64_t used
+        // wherever its type is known to be int or boolean, and a Value used
+        // everywhere else. Where control flow joins a place that needs the
+        // Value, the scalar is boxed on the way in.
+        class FunctionTranslator {
+        public:
+            FunctionTranslator(const Bytecode::Program& program, uint32_t index, std::string& out)
+                : program(program), code(program.code), function(program.functions[index]), index(index),
+                  low(-static_cast<int32_t>(program.functions[index].arguments)), out(out) {}
+
+            void Translate() {
+                Analyze();
+
+                std::string body;
+                if (states.empty()) {
+                    Line(body, "Finish();");
+                } else {
+                    // Tail calls of the function itself jump back to here
+                    for (const auto& [i, state] : states) {
+                        if (IsSelfTailCall(i)) {
+                            body += "    restart:;\n";
+                            break;
+                        }
+                    }
+
+                    // The values this function may consume from its caller
+                    for (int32_t p = -1; p >= low; p--)
+                        Line(body, "{} = rt.stack.Pop();", Stack(p, AnyT));
+
+                    std::set<uint32_t> labels;
+                    for (const auto& [i, state] : states) {
+                        const auto& ins = code[i];
+                        if ((ins.op == Opcode::JMP || ins.op == Opcode::JZ || ins.op == Opcode::JNZ) && ins.operand < code.size())
+                            labels.insert(ins.operand);
+                    }
+
+                    for (const auto& [i, state] : states) {
+                        if (labels.count(i))
+                            body += fmt::format("    L{}:;\n", i);
+                        Emit(i, state, body);
+                    }
+                }
+
+                out += fmt::format("    // fn {}\n", function.name);
+                out += fmt::format("    void fn{}(Runtime& rt) {{\n", index);
+                for (const auto& [name, scalar] : variables)
+                    Line(out, "{} {}{};", scalar ? "int64_t" : "Value", name, scalar ? " = 0" : "");
+                out += body;
+                out += "    }\n\n";
+            }
+
+        private:
+            const Bytecode::Program& program;
+            const std::vector<Bytecode::Instruction>& code;
+            const Bytecode::Function& function;
+            uint32_t index;
+            int32_t low; // deepest stack position the function reaches
+            std::string& out;
+
+            std::map<uint32_t, State> states;    // before each reachable instruction
+            std::map<std::string, bool> variables; // used so far, and whether they are int64_t
+
+            // Whether instruction `i` calls this function and returns what the
+            // call leaves: CALL; RET, or CALL; STORE r; LOAD r; RET as
+            // `f(); pop r; return r` compiles when not optimized
+            bool IsSelfTailCall(uint32_t i) const {
+                if (code[i].op != Opcode::CALL || code[i].operand != index)
+                    return false;
+                if (i + 1 < code.size() && code[i + 1].op == Opcode::RET)
+                    return true;
+                return i + 3 < code.size() && code[i + 1].op == Opcode::STORE && code[i + 2].op == Opcode::LOAD &&
+                       code[i + 1].operand == code[i + 2].operand && code[i + 3].op == Opcode::RET;
+            }
+
+            struct Successors {
+                uint32_t targets[2];
+                size_t count = 0;
+            };
+
+            // Applies instruction `i` to `state` and lists where control goes
+            // next (the end of the code included)
+            Successors Step(uint32_t i, State& state) const {
+                const auto& ins = code[i];
+                Successors next;
+                auto then = [&](uint32_t target) { next.targets[next.count++] = target; };
+
+                switch (ins.op) {
+                case Opcode::NOP:
+                case Opcode::DEF:
+                    then(i + 1);
+                    break;
+                case Opcode::PUSH:
+                    state.Push(Bit(program.constants[ins.operand].Type()));
+                    then(i + 1);
+                    break;
+                case Opcode::POP:
+                case Opcode::PRINT:
+                    state.Pop();
+                    then(i + 1);
+                    break;
+                case Opcode::INPUT:
+                    state.Push(StringT);
+                    then(i + 1);
+                    break;
+                case Opcode::TOINT:
+                    state.Pop();
+                    state.Push(IntT);
+                    then(i + 1);
+                    break;
+                case Opcode::ADD:
+                case Opcode::SUB:
+                case Opcode::MUL:
+                case Opcode::DIV: {
+                    TypeSet top = state.Pop();
+                    TypeSet below = state.Pop();
+                    state.Push(Combine(ins.op, below, top));
+                    then(i + 1);
+                    break;
+                }
+                case Opcode::CMP:
+                    state.Pop();
+                    state.Pop();
+                    state.Push(BoolT);
+                    then(i + 1);
+                    break;
+                case Opcode::SUBSTR:
+                    state.Pop();
+                    state.Pop();
+                    state.Pop();
+                    state.Push(StringT);
+                    then(i + 1);
+                    break;
+                case Opcode::STORE:
+                    state.locals[ins.operand] = state.Pop();
+                    then(i + 1);
+                    break;
+                case Opcode::LOAD:
+                    state.Push(state.locals[ins.operand]);
+                    then(i + 1);
+                    break;
+                case Opcode::JMP:
+                    then(ins.operand);
+                    break;
+                case Opcode::JZ:
+                case Opcode::JNZ:
+                    state.Pop();
+                    then(i + 1);
+                    then(ins.operand);
+                    break;
+                case Opcode::CALL: {
+                    const auto& callee = program.functions[ins.operand];
+                    for (uint32_t k = 0; k < callee.arguments; k++)
+                        state.Pop();
+                    for (int32_t k = 0; k < static_cast<int32_t>(callee.arguments) + callee.effect; k++)
+                        state.Push(AnyT);
+                    if (callee.returns)
+                        then(i + 1);
+                    break;
+                }
+                default: // RET, HALT
+                    break;
+                }
+                return next;
+            }
+
+            void Analyze() {
+                if (function.entry >= code.size())
+                    return;
+
+                State entry;
+                entry.low = low;
+                entry.stack.assign(function.arguments, AnyT);
+                entry.locals.assign(function.localCount, 0);
+                states.emplace(function.entry, entry);
+
+                std::vector<uint32_t> worklist = {function.entry};
+                while (!worklist.empty()) {
+                    uint32_t i = worklist.back();
+                    worklist.pop_back();
+
+                    State state = states.at(i);
+                    Successors next = Step(i, state);
+                    for (size_t k = 0; k < next.count; k++) {
+                        uint32_t target = next.targets[k];
+                        if (target >= code.size())
+                            continue;
+                        auto [it, inserted] = states.emplace(target, state);
+                        if (inserted || it->second.Merge(state))
+                            worklist.push_back(target);
+                    }
+                }
+            }
+
+            template <typename... Args>
+            static void Line(std::string& out, fmt::format_string<Args...> format, Args&&... args) {
+                out += "        ";
+                out += fmt::format(format, std::forward<Args>(args)...);
+                out += '\n';
+            }
+
+            std::string Variable(std::string name, bool scalar) {
+                if (scalar)
+                    name += 'i';
+                variables.emplace(name, scalar);
+                return name;
+            }
+
+            // The variable holding stack position `position` while it is one of `types`
+            std::string Stack(int32_t position, TypeSet types) {
+                return Variable(fmt::format("s{}", position - low), IsScalar(types));
+            }
+
+            std::string Local(uint32_t slot, TypeSet types) {
+                return Variable(fmt::format("l{}", slot), IsScalar(types));
+            }
+
+            // A Value expression for a variable holding one of `types`
+            static std::string Boxed(const std::string& variable, TypeSet types, bool consume) {
+                if (types == IntT)
+                    return fmt::format("Value(int64_t{{{}}})", variable);
+                if (types == BoolT)
+                    return fmt::format("Value({} != 0)", variable);
+                return consume ? fmt::format("std::move({})", variable) : variable;
+            }
+
+            std::string ValueOf(const State& state, int32_t position, bool consume = false) {
+                TypeSet types = state.At(position);
+                return Boxed(Stack(position, types), types, consume);
+            }
+
+            // Sets `position`, of `types` afterwards, to a Value expression
+            void AssignValue(std::string& body, int32_t position, TypeSet types, const std::string& value) {
+                if (IsScalar(types))
+                    Line(body, "{} = ({}).{}();", Stack(position, types), value, types == IntT ? "AsInt" : "AsBool");
+                else
+                    Line(body, "{} = {};", Stack(position, types), value);
+            }
+
+            // Boxes what control flow from `from` into `to` needs as a Value
+            std::string Convert(const State& from, const State& to) {
+                std::string lines;
+                for (int32_t p = low; p < to.Depth(); p++) {
+                    if (IsScalar(from.At(p)) && !IsScalar(to.At(p)))
+                        Line(lines, "{} = {};", Stack(p, to.At(p)), Boxed(Stack(p, from.At(p)), from.At(p), false));
+                }
+                for (uint32_t x = 0; x < function.localCount; x++) {
+                    if (IsScalar(from.locals[x]) && !IsScalar(to.locals[x]))
+                        Line(lines, "{} = {};", Local(x, to.locals[x]), Boxed(Local(x, from.locals[x]), from.locals[x], false));
+                }
+                return lines;
+            }
+
+            // Code for going from `from` to instruction `target`
+            std::string Goto(const State& from, uint32_t target) {
+                if (target >= code.size())
+                    return "Finish();";
+                std::string lines = Convert(from, states.at(target));
+                if (lines.empty())
+                    return fmt::format("goto L{};", target);
+                // Only the branch taken needs the conversions
+                return fmt::format("{{\n{}            goto L{};\n        }}", Indent(lines), target);
+            }
+
+            static std::string Indent(const std::string& lines) {
+                std::string indented;
+                size_t start = 0;
+                while (start < lines.size()) {
+                    size_t end = lines.find('\n', start);
+                    indented += "    " + lines.substr(start, end + 1 - start);
+                    start = end + 1;
+                }
+                return indented;
+            }
+
+            void Emit(uint32_t i, const State& in, std::string& body) {
+                const auto& ins = code[i];
+                State after = in;
+                Successors next = Step(i, after);
+                int32_t d = in.Depth();
+
+                if (ins.op == Opcode::PUSH && !program.constants[ins.operand].IsString())
+                    Line(body, "// {}: PUSH {}", i, program.constants[ins.operand].ToString());
+                else if (ins.op == Opcode::CALL)
+                    Line(body, "// {}: CALL {}", i, program.functions[ins.operand].name);
+                else
+                    Line(body, "// {}: {} {}", i, Bytecode::Name(ins.op), ins.operand);
+
+                switch (ins.op) {
+                case Opcode::NOP:
+                case Opcode::DEF:
+                    break;
+
+                case Opcode::PUSH: {
+                    const Types::Value& constant = program.constants[ins.operand];
+                    TypeSet types = after.At(d);
+                    if (types == IntT)
+                        Line(body, "{} = {};", Stack(d, types), IntLiteral(constant.AsInt()));
+                    else if (types == BoolT)
+                        Line(body, "{} = {};", Stack(d, types), constant.AsBool() ? 1 : 0);
+                    else
+                        Line(body, "{} = k[{}];", Stack(d, types), ins.operand);
+                    break;
+                }
+
+                case Opcode::POP:
+                    // Drops the reference so strings can be appended to in place again
+                    if (!IsScalar(in.At(d - 1)))
+                        Line(body, "{} = Value();", Stack(d - 1, in.At(d - 1)));
+                    break;
+
+                case Opcode::LOAD: {
+                    TypeSet types = in.locals[ins.operand];
+                    Line(body, "{} = {};", Stack(d, types), Local(ins.operand, types));
+                    break;
+                }
+
+                case Opcode::STORE: {
+                    TypeSet types = in.At(d - 1);
+                    Line(body, "{} = {};", Local(ins.operand, types),
+                        IsScalar(types) ? Stack(d - 1, types) : fmt::format("std::move({})", Stack(d - 1, types)));
+                    break;
+                }
+
+                case Opcode::ADD:
+                case Opcode::SUB:
+                case Opcode::MUL:
+                case Opcode::DIV: {
+                    // Same operand order as the interpreter: ADD is Top(1) + Top(0),
+                    // the others compute Top(0) op Top(1)
+                    int32_t a = d - 2, b = d - 1;
+                    TypeSet ta = in.At(a), tb = in.At(b);
+                    TypeSet result = after.At(a);
+                    if (ta == IntT && tb == IntT) {
+                        std::string sa = Stack(a, IntT), sb = Stack(b, IntT);
+                        switch (ins.op) {
+                        case Opcode::ADD: Line(body, "{} = IntAdd({}, {});", sa, sa, sb); break;
+                        case Opcode::SUB: Line(body, "{} = IntSub({}, {});", sa, sb, sa); break;
+                        case Opcode::MUL: Line(body, "{} = IntMul({}, {});", sa, sb, sa); break;
+                        default: Line(body, "{} = IntDiv({}, {});", sa, sb, sa); break;
+                        }
+                    } else if (ins.op == Opcode::ADD && !IsScalar(ta) && !IsScalar(result)) {
+                        Line(body, "AddTo({}, {});", Stack(a, ta), ValueOf(in, b));
+                    } else if (ins.op == Opcode::ADD) {
+                        AssignValue(body, a, result, fmt::format("{} + {}", ValueOf(in, a), ValueOf(in, b)));
+                    } else {
+                        const char* op = ins.op == Opcode::SUB ? "-" : ins.op == Opcode::MUL ? "*" : "/";
+                        AssignValue(body, a, result, fmt::format("{} {} {}", ValueOf(in, b), op, ValueOf(in, a)));
+                    }
+                    break;
+                }
+
+                case Opcode::CMP: {
+                    int32_t a = d - 2, b = d - 1;
+                    if (in.At(a) == IntT && in.At(b) == IntT)
+                        Line(body, "{} = {} == {};", Stack(a, BoolT), Stack(a, IntT), Stack(b, IntT));
+                    else
+                        Line(body, "{} = Equals({}, {});", Stack(a, BoolT), ValueOf(in, a), ValueOf(in, b));
+                    break;
+                }
+
+                case Opcode::JZ:
+                case Opcode::JNZ: {
+                    TypeSet types = in.At(d - 1);
+                    std::string top = Stack(d - 1, types);
+                    std::string truthy;
+                    if (IsScalar(types))
+                        truthy = fmt::format("{} != 0", top);
+                    else
+                        truthy = fmt::format("{}.IsTruthy()", top);
+                    if (ins.op == Opcode::JZ)
+                        Line(body, "if (!({})) {}", truthy, Goto(after, ins.operand));
+                    else
+                        Line(body, "if ({}) {}", truthy, Goto(after, ins.operand));
+                    break;
+                }
+
+                case Opcode::JMP:
+                    Line(body, "{}", Goto(after, ins.operand));
+                    return;
+
+                case Opcode::HALT:
+                    Line(body, "Finish();");
+                    return;
+
+                case Opcode::PRINT:
+                    Line(body, "rt.output.Write({});", ValueOf(in, d - 1));
+                    break;
+
+                case Opcode::INPUT:
+                    // Make sure any prompt is visible before blocking on input
+                    Line(body, "rt.output.Flush();");
+                    Line(body, "{} = Value(rt.input.ReadLine());", Stack(d, StringT));
+                    break;
+
+                case Opcode::TOINT:
+                    if (in.At(d - 1) != IntT)
+                        Line(body, "{} = ToInt({});", Stack(d - 1, IntT), ValueOf(in, d - 1));
+                    break;
+
+                case Opcode::SUBSTR:
+                    Line(body, "{} = Substr({}, {}, {});", Stack(d - 3, StringT), ValueOf(in, d - 3), ValueOf(in, d - 2),
+                        ValueOf(in, d - 1));
+                    break;
+
+                case Opcode::CALL: {
+                    const auto& callee = program.functions[ins.operand];
+                    int32_t args = static_cast<int32_t>(callee.arguments);
+                    if (IsSelfTailCall(i)) {
+                        // Whatever lies below the arguments is handed back
+                        // before the callee's values, as RET would after the
+                        // call; the native stack does not grow
+                        for (int32_t p = low; p < d; p++)
+                            Line(body, "rt.stack.Push({});", ValueOf(in, p, true));
+                        Line(body, "goto restart;");
+                        return;
+                    }
+                    for (int32_t p = d - args; p < d; p++)
+                        Line(body, "rt.stack.Push({});", ValueOf(in, p, true));
+                    Line(body, "fn{}(rt);", ins.operand);
+                    if (!callee.returns) {
+                        Line(body, "Finish();");
+                        return;
+                    }
+                    for (int32_t p = d + callee.effect - 1; p >= d - args; p--)
+                        Line(body, "{} = rt.stack.TakeTop();", Stack(p, AnyT));
+                    break;
+                }
+
+                case Opcode::RET:
+                    // Hands back everything it holds, its return value on top
+                    for (int32_t p = low; p < d; p++)
+                        Line(body, "rt.stack.Push({});", ValueOf(in, p, true));
+                    Line(body, "return;");
+                    return;
+
+                default:
+                    throw VM::Core::RuntimeException(fmt::format("Cannot translate opcode 0x{:02X} at instruction {}",
+                        static_cast<uint8_t>(ins.op), i));
+                }
+
+                // Falling through: to the next instruction, or off the end of
+                // the code, which ends the program
+                if (next.count > 0) {
+                    if (next.targets[0] >= code.size())
+                        Line(body, "Finish();");
+                    else
+                        body += Convert(after, states.at(next.targets[0]));
+                }
+            }
+        };
+    }
+
+
+    CppEmitter::CppEmitter(const Bytecode::Program& program)
+        : program(program), logger("AOT/CppEmitter") {}
+
+    void CppEmitter::EmitConstants(std::string& out) const {
+        const auto& constants = program.constants;
+        if (!constants.empty())
+            out += fmt::format("    Value k[{}];\n\n", constants.size());
+
+        out += "    void InitConstants() {\n";
+        for (size_t i = 0; i < constants.size(); i++) {
+            const Types::Value& value = constants[i];
+            std::string init;
+            switch (value.Type()) {
+            case ValueType::Integer:
+                init = fmt::format("Value({})", IntLiteral(value.AsInt()));
+                break;
+            case ValueType::Double:
+                init = fmt::format("Value(std::bit_cast<double>(uint64_t{{0x{:016X}}}))", std::bit_cast<uint64_t>(value.AsDouble()));
+                break;
+            case ValueType::Boolean:
+                init = value.AsBool() ? "Value(true)" : "Value(false)";
+                break;
+            case ValueType::String:
+                init = fmt::format("Value(std::string_view({}, {}))", StringLiteral(value.AsString()), value.AsString().size());
+                break;
+            default:
+                init = "Value()";
+                break;
+            }
+            out += fmt::format("        k[{}] = {};\n", i, init);
+        }
+        out += "    }\n\n";
+    }
+
+    void CppEmitter::EmitFunction(uint32_t index, std::string& out) const {
+        FunctionTranslator(program, index, out).Translate();
+    }
+
+    std::string CppEmitter::Emit(std::string_view origin) {
+        if (!program.verified)
+            throw VM::Core::RuntimeException("Only verified programs can be translated to C++");
+
+        auto main = program.functionTable.find("main");
+        if (main == program.functionTable.end())
+            throw VM::Core::RuntimeException("No 'main' function defined");
+
+        std::string out;
+        out += fmt::format("// Translated from {} by dotnyet --emit-cpp. Do not edit.\n", origin);
+        out += "#include <DotNyet/AOT/Runtime.hpp>\n"
+               "#include <bit>\n"
+               "#include <cstdint>\n"
+               "#include <string_view>\n"
+               "#include <utility>\n\n"
+               "namespace {\n"
+               "    using namespace DotNyet::AOT;\n"
+               "    using namespace DotNyet::Types;\n\n";
+
+        EmitConstants(out);
+
+        for (uint32_t f = 0; f < program.functions.size(); f++)
+            out += fmt::format("    void fn{}(Runtime& rt);\n", f);
+        out += "\n";
+
+        for (uint32_t f = 0; f < program.functions.size(); f++)
+            EmitFunction(f, out);
+
+        out += "}\n\n"
+               "int main(int argc, char* argv[]) {\n"
+               "    InitConstants();\n";
+        out += fmt::format("    return DotNyet::AOT::Main(argc, argv, fn{});\n", main->second);
+        out += "}\n";
+
+        logger.Info("Translated {} functions ({} instructions) to {} bytes of C++", program.functions.size(), program.code.size(), out.size());
+        return out;
+    }
+}
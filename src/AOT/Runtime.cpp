@@ -0,0 +1,53 @@
+#include <DotNyet/AOT/Runtime.hpp>
+#include <DotNyet/Core/Exceptions.hpp>
+#include <Util/Log.hpp>
+#include <Util/Demangle.hpp>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <typeinfo>
+
+namespace DotNyet::AOT {
+
+    namespace {
+        // Thrown by Finish() and caught in Main()
+        struct Halt {};
+    }
+
+    void Finish() {
+        throw Halt{};
+    }
+
+    int64_t IntDiv(int64_t a, int64_t b) {
+        if (b == 0)
+            throw VM::Core::RuntimeException("Division by zero");
+        if (b == -1)
+            return IntSub(0, a);
+        return a / b;
+    }
+
+    int Main(int argc, char* argv[], Entry main) {
+        Util::Logger logger("AOT");
+        Util::Logger::SetLogLevel(Util::Logger::Level::Error);
+
+        int first = argc > 1 && std::strcmp(argv[1], "--") == 0 ? 2 : 1;
+        std::string args;
+        for (int i = first; i < argc; i++) {
+            if (!args.empty()) args += " ";
+            args += argv[i];
+        }
+
+        Runtime rt;
+        rt.stack.Push(Value(args));
+        try {
+            main(rt);
+        } catch (const Halt&) {
+        } catch (const std::exception& e) {
+            rt.output.Flush();
+            logger.Error("Exception caught [{}]: {}", demangle(typeid(e).name()).c_str(), e.what());
+            return 1;
+        }
+        rt.output.Flush();
+        return 0;
+    }
+}
@@ -0,0 +1,515 @@
+#include <DotNyet/Bytecode/Assembler.hpp>
+#include <DotNyet/Bytecode/MappedFile.hpp>
+#include <DotNyet/Bytecode/Opcodes.hpp>
+#include <DotNyet/Core/Exceptions.hpp>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <cstring>
+#include <fmt/core.h>
+
+namespace DotNyet::Bytecode {
+
+    using VM::Core::AssemblerException;
+
+    namespace {
+        enum CharClass : uint8_t {
+            Space = 1,       // skipped (newlines are tokens of their own)
+            IdentStart = 2,  // letters and '_'; bytes of UTF-8 sequences count as letters
+            IdentPart = 4,   // IdentStart plus digits
+            NumberStart = 8, // digits and '-'
+            NumberPart = 16, // digits, '-' and '.'
+        };
+
+        constexpr std::array<uint8_t, 256> MakeClasses() {
+            std::array<uint8_t, 256> classes {};
+            // Everything Python's str.isspace() accepts in ASCII
+            for (unsigned char c : {' ', '\t', '\r', '\v', '\f', '\x1c', '\x1d', '\x1e', '\x1f'})
+                classes[c] |= Space;
+            for (unsigned c = 0; c < 256; c++) {
+                bool letter = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c >= 0x80;
+                bool digit = c >= '0' && c <= '9';
+                if (letter)
+                    classes[c] |= IdentStart | IdentPart;
+                if (digit)
+                    classes[c] |= IdentPart | NumberStart | NumberPart;
+            }
+            classes['-'] |= NumberStart | NumberPart;
+            classes['.'] |= NumberPart;
+            return classes;
+        }
+
+        constexpr std::array<uint8_t, 256> Classes = MakeClasses();
+
+        bool Is(char c, CharClass cls) {
+            return Classes[static_cast<unsigned char>(c)] & cls;
+        }
+
+        struct Keyword {
+            std::string_view name;
+            Opcode op; // for the keywords that are a single instruction
+        };
+
+        constexpr Keyword Keywords[] = {
+            {"fn", Opcode::NOP}, {"var", Opcode::NOP}, {"push", Opcode::NOP}, {"pop", Opcode::NOP},
+            {"return", Opcode::NOP}, {"jmp", Opcode::JMP}, {"jz", Opcode::JZ}, {"jnz", Opcode::JNZ},
+            {"print", Opcode::PRINT}, {"input", Opcode::INPUT}, {"add", Opcode::ADD}, {"sub", Opcode::SUB},
+            {"mul", Opcode::MUL}, {"div", Opcode::DIV}, {"cmp", Opcode::CMP}, {"toint", Opcode::TOINT},
+            {"substr", Opcode::SUBSTR},
+        };
+
+        const Keyword* FindKeyword(std::string_view text) {
+            for (const auto& keyword : Keywords) {
+                if (keyword.name == text)
+                    return &keyword;
+            }
+            return nullptr;
+        }
+
+        void AppendUInt32(std::string& out, uint32_t value) {
+            for (int i = 0; i < 4; i++)
+                out += static_cast<char>(value >> (8 * i));
+        }
+
+        void AppendUInt64(std::string& out, uint64_t value) {
+            for (int i = 0; i < 8; i++)
+                out += static_cast<char>(value >> (8 * i));
+        }
+
+        void AppendUtf8(std::string& out, uint32_t cp) {
+            if (cp < 0x80) {
+                out += static_cast<char>(cp);
+            } else if (cp < 0x800) {
+                out += static_cast<char>(0xC0 | (cp >> 6));
+                out += static_cast<char>(0x80 | (cp & 0x3F));
+            } else if (cp < 0x10000) {
+                out += static_cast<char>(0xE0 | (cp >> 12));
+                out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (cp & 0x3F));
+            } else {
+                out += static_cast<char>(0xF0 | (cp >> 18));
+                out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+                out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (cp & 0x3F));
+            }
+        }
+
+        int HexDigit(char c) {
+            if (c >= '0' && c <= '9') return c - '0';
+            if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+            if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+            return -1;
+        }
+    }
+
+    Assembler::Assembler(std::string_view source)
+        : source(source), scopes(1), locals(&topLevel), logger("Bytecode/Assembler") {}
+
+    void Assembler::Fail(const std::string& message) const {
+        throw AssemblerException(message);
+    }
+
+    Assembler::Token Assembler::Lex() {
+        while (pos < source.size()) {
+            char c = source[pos];
+
+            if (c == '\n') {
+                pos++;
+                return Token{TokenType::Newline, source.substr(pos - 1, 1), line++};
+            }
+            if (Is(c, Space)) {
+                pos++;
+                continue;
+            }
+            if (c == '#') {
+                const void* newline = std::memchr(source.data() + pos, '\n', source.size() - pos);
+                pos = newline ? static_cast<size_t>(static_cast<const char*>(newline) - source.data()) : source.size();
+                continue;
+            }
+
+            size_t start = pos;
+            if (Is(c, IdentStart)) {
+                while (pos < source.size() && Is(source[pos], IdentPart))
+                    pos++;
+                std::string_view text = source.substr(start, pos - start);
+                return Token{FindKeyword(text) ? TokenType::Keyword : TokenType::Identifier, text, line};
+            }
+            if (Is(c, NumberStart)) {
+                while (pos < source.size() && Is(source[pos], NumberPart))
+                    pos++;
+                return Token{TokenType::Number, source.substr(start, pos - start), line};
+            }
+            if (c == '"') {
+                const void* quote = std::memchr(source.data() + pos + 1, '"', source.size() - pos - 1);
+                if (!quote)
+                    Fail(fmt::format("Unterminated string at line {}", line));
+                size_t end = static_cast<size_t>(static_cast<const char*>(quote) - source.data());
+                Token token{TokenType::String, source.substr(start + 1, end - start - 1), line};
+                for (char ch : token.text)
+                    line += ch == '\n';
+                pos = end + 1;
+                return token;
+            }
+            if (std::string_view("(),=:").find(c) != std::string_view::npos) {
+                pos++;
+                return Token{TokenType::Symbol, source.substr(start, 1), line};
+            }
+
+            Fail(fmt::format("Invalid character at line {}: {}", line, c));
+        }
+        return Token{TokenType::End, {}, line};
+    }
+
+    Assembler::Token Assembler::Next() {
+        if (hasPeeked) {
+            hasPeeked = false;
+            return peeked;
+        }
+        return Lex();
+    }
+
+    Assembler::Token Assembler::Peek() {
+        if (!hasPeeked) {
+            peeked = Lex();
+            hasPeeked = true;
+        }
+        return peeked;
+    }
+
+    Assembler::Token Assembler::Expect(TokenType type, const char* what) {
+        Token token = Next();
+        if (token.type != type)
+            Fail(fmt::format("Expected {} at line {}, got '{}'", what, token.line, token.text));
+        return token;
+    }
+
+    void Assembler::ExpectSymbol(char symbol) {
+        Token token = Next();
+        if (token.type != TokenType::Symbol || token.text[0] != symbol)
+            Fail(fmt::format("Expected '{}' at line {}, got '{}'", symbol, token.line, token.text));
+    }
+
+    std::vector<uint8_t> Assembler::Assemble() {
+        for (Token token = Next(); token.type != TokenType::End; token = Next()) {
+            if (token.type != TokenType::Newline)
+                Statement(token);
+        }
+
+        for (const auto& fixup : fixups) {
+            auto it = labels.find(fixup.label);
+            if (it == labels.end())
+                Fail(fmt::format("Undefined label: {}", fixup.label));
+            auto target = static_cast<uint32_t>(it->second);
+            for (int i = 0; i < 4; i++)
+                code[fixup.at + i] = static_cast<uint8_t>(target >> (8 * i));
+        }
+        EmitByte(static_cast<uint8_t>(Opcode::HALT));
+
+        std::vector<uint8_t> image;
+        image.reserve(9 + constants.size() + code.size());
+        image.push_back('N');
+        image.push_back('Y');
+        image.push_back('E');
+        image.push_back('T');
+        image.push_back(FormatVersion2);
+        for (int i = 0; i < 4; i++)
+            image.push_back(static_cast<uint8_t>(constantCount >> (8 * i)));
+        image.insert(image.end(), constants.begin(), constants.end());
+        image.insert(image.end(), code.begin(), code.end());
+
+        NYET_LOG_DEBUG(logger, "Assembled {} bytes of source into {} bytes of code and {} constants",
+            source.size(), code.size(), constantCount);
+        return image;
+    }
+
+    void Assembler::Statement(const Token& token) {
+        if (token.type == TokenType::Keyword) {
+            const Keyword* keyword = FindKeyword(token.text);
+            if (token.text == "fn") {
+                Function();
+            } else if (token.text == "var") {
+                Token name = Expect(TokenType::Identifier, "variable name");
+                if (locals->contains(name.text))
+                    Fail(fmt::format("Variable {} already defined at line {}", name.text, name.line));
+                (*locals)[name.text] = localCount++;
+            } else if (token.text == "push") {
+                EmitValue(Value());
+            } else if (token.text == "return") {
+                EmitValue(Value());
+                EmitByte(static_cast<uint8_t>(Opcode::RET));
+            } else if (token.text == "pop") {
+                EmitStore(Expect(TokenType::Identifier, "variable name"));
+            } else if (keyword->op == Opcode::JMP || keyword->op == Opcode::JZ || keyword->op == Opcode::JNZ) {
+                Token label = Expect(TokenType::Identifier, "label");
+                EmitByte(static_cast<uint8_t>(keyword->op));
+                fixups.push_back(Fixup{code.size(), label.text});
+                EmitUInt32(0);
+            } else {
+                EmitByte(static_cast<uint8_t>(keyword->op));
+            }
+            return;
+        }
+
+        if (token.type == TokenType::Identifier) {
+            Token next = Peek();
+            if (next.type == TokenType::Symbol && next.text[0] == ':') {
+                Next();
+                labels[token.text] = code.size();
+                return;
+            }
+            if (next.type == TokenType::Symbol && next.text[0] == '(') {
+                Next();
+                std::vector<Operand> args;
+                if (!(Peek().type == TokenType::Symbol && Peek().text[0] == ')')) {
+                    args.push_back(Value());
+                    while (Peek().type == TokenType::Symbol && Peek().text[0] == ',') {
+                        Next();
+                        args.push_back(Value());
+                    }
+                }
+                ExpectSymbol(')');
+                // The first argument ends up on top of the stack
+                for (auto it = args.rbegin(); it != args.rend(); ++it)
+                    EmitValue(*it);
+                EmitByte(static_cast<uint8_t>(Opcode::CALL));
+                EmitUInt32(NameConstant(token.text));
+                return;
+            }
+            if (next.type == TokenType::Symbol && next.text[0] == '=') {
+                Next();
+                EmitValue(Value());
+                EmitStore(token);
+                return;
+            }
+        }
+
+        Fail(fmt::format("Invalid statement at line {}: {}", token.line, token.text));
+    }
+
+    void Assembler::Function() {
+        Token name = Expect(TokenType::Identifier, "function name");
+        ExpectSymbol('(');
+        std::vector<std::string_view> declared;
+        if (!(Peek().type == TokenType::Symbol && Peek().text[0] == ')')) {
+            declared.push_back(Expect(TokenType::Identifier, "parameter name").text);
+            while (Peek().type == TokenType::Symbol && Peek().text[0] == ',') {
+                Next();
+                declared.push_back(Expect(TokenType::Identifier, "parameter name").text);
+            }
+        }
+        ExpectSymbol(')');
+        Expect(TokenType::Newline, "end of line");
+
+        paramStack.push_back(std::move(params));
+        params = std::move(declared);
+        scopes.emplace_back();
+        locals = &scopes.back();
+        localCount = static_cast<uint32_t>(params.size());
+        EmitByte(static_cast<uint8_t>(Opcode::DEF));
+        EmitUInt32(NameConstant(name.text));
+
+        // The body runs up to and including the first `return` at this level
+        for (;;) {
+            Token token = Next();
+            if (token.type == TokenType::End)
+                Fail(fmt::format("Function {} defined at line {} has no return", name.text, name.line));
+            if (token.type == TokenType::Newline)
+                continue;
+            Statement(token);
+            if (token.type == TokenType::Keyword && token.text == "return")
+                break;
+        }
+
+        params = std::move(paramStack.back());
+        paramStack.pop_back();
+        scopes.pop_back();
+        locals = &scopes.back();
+        localCount = static_cast<uint32_t>(params.size());
+    }
+
+    Assembler::Operand Assembler::Value() {
+        Token token = Next();
+        Operand operand;
+        operand.text = token.text;
+
+        switch (token.type) {
+            case TokenType::Identifier:
+                break;
+            case TokenType::String:
+                DecodeString(token, operand);
+                break;
+            case TokenType::Number: {
+                const char* first = token.text.data();
+                const char* last = first + token.text.size();
+                std::from_chars_result result;
+                if (token.text.find('.') != std::string_view::npos) {
+                    operand.kind = Operand::Kind::Double;
+                    result = std::from_chars(first, last, operand.number);
+                } else {
+                    operand.kind = Operand::Kind::Integer;
+                    result = std::from_chars(first, last, operand.integer);
+                }
+                if (result.ec != std::errc() || result.ptr != last)
+                    Fail(fmt::format("Invalid number at line {}: {}", token.line, token.text));
+                break;
+            }
+            default:
+                Fail(fmt::format("Invalid value at line {}: {}", token.line, token.type == TokenType::Newline ? "end of line" : token.text));
+        }
+        return operand;
+    }
+
+    // Python's "unicode_escape" rules, which dotnyet.py applies to every string
+    void Assembler::DecodeString(const Token& token, Operand& operand) const {
+        std::string_view text = token.text;
+        if (text.find('\\') == std::string_view::npos)
+            return;
+
+        operand.escaped = true;
+        std::string& out = operand.decoded;
+        out.reserve(text.size());
+        for (size_t i = 0; i < text.size(); i++) {
+            if (text[i] != '\\') {
+                out += text[i];
+                continue;
+            }
+            if (++i == text.size())
+                Fail(fmt::format("\\ at end of string at line {}", token.line));
+
+            char c = text[i];
+            switch (c) {
+                case '\n': break;
+                case '\\': out += '\\'; break;
+                case '\'': out += '\''; break;
+                case '"': out += '"'; break;
+                case 'a': out += '\a'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'v': out += '\v'; break;
+                case 'x':
+                case 'u':
+                case 'U': {
+                    size_t digits = c == 'x' ? 2 : c == 'u' ? 4 : 8;
+                    uint32_t cp = 0;
+                    for (size_t k = 0; k < digits; k++) {
+                        int digit = i + 1 < text.size() ? HexDigit(text[i + 1]) : -1;
+                        if (digit < 0)
+                            Fail(fmt::format("Truncated \\{} escape in string at line {}", c, token.line));
+                        cp = cp << 4 | static_cast<uint32_t>(digit);
+                        i++;
+                    }
+                    if (cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+                        Fail(fmt::format("Invalid character U+{:X} in string at line {}", cp, token.line));
+                    AppendUtf8(out, cp);
+                    break;
+                }
+                case 'N':
+                    Fail(fmt::format("\\N{{...}} escapes are not supported (string at line {})", token.line));
+                default:
+                    if (c >= '0' && c <= '7') {
+                        uint32_t cp = static_cast<uint32_t>(c - '0');
+                        for (int k = 0; k < 2 && i + 1 < text.size() && text[i + 1] >= '0' && text[i + 1] <= '7'; k++)
+                            cp = cp * 8 + static_cast<uint32_t>(text[++i] - '0');
+                        AppendUtf8(out, cp);
+                    } else {
+                        // Unknown escapes stay as they are
+                        out += '\\';
+                        out += c;
+                    }
+                    break;
+            }
+        }
+    }
+
+    void Assembler::EmitByte(uint8_t byte) {
+        code.push_back(byte);
+    }
+
+    void Assembler::EmitUInt32(uint32_t value) {
+        for (int i = 0; i < 4; i++)
+            code.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+
+    bool Assembler::FindVariable(std::string_view name, uint32_t& slot) const {
+        for (size_t i = 0; i < params.size(); i++) {
+            if (params[i] == name) {
+                slot = static_cast<uint32_t>(i);
+                return true;
+            }
+        }
+        auto it = locals->find(name);
+        if (it == locals->end())
+            return false;
+        slot = it->second;
+        return true;
+    }
+
+    void Assembler::EmitValue(const Operand& operand) {
+        uint32_t slot;
+        if (operand.kind == Operand::Kind::String && FindVariable(operand.Text(), slot)) {
+            EmitByte(static_cast<uint8_t>(Opcode::LOAD));
+            EmitUInt32(slot);
+            return;
+        }
+        EmitByte(static_cast<uint8_t>(Opcode::PUSH));
+        EmitUInt32(Constant(operand));
+    }
+
+    void Assembler::EmitStore(const Token& name) {
+        uint32_t slot;
+        if (!FindVariable(name.text, slot))
+            Fail(fmt::format("Undefined variable at line {}: {}", name.line, name.text));
+        EmitByte(static_cast<uint8_t>(Opcode::STORE));
+        EmitUInt32(slot);
+    }
+
+    // Equal constants share one pool entry. They are told apart by their
+    // encoding, so 1 and "1" stay separate.
+    uint32_t Assembler::Constant(const Operand& operand) {
+        std::string encoded;
+        switch (operand.kind) {
+            case Operand::Kind::Integer:
+                encoded += static_cast<char>(ValueTypeTag::Integer);
+                AppendUInt64(encoded, static_cast<uint64_t>(operand.integer));
+                break;
+            case Operand::Kind::Double:
+                encoded += static_cast<char>(ValueTypeTag::Double);
+                AppendUInt64(encoded, std::bit_cast<uint64_t>(operand.number));
+                break;
+            case Operand::Kind::String: {
+                std::string_view text = operand.Text();
+                encoded.reserve(5 + text.size());
+                encoded += static_cast<char>(ValueTypeTag::String);
+                AppendUInt32(encoded, static_cast<uint32_t>(text.size()));
+                encoded += text;
+                break;
+            }
+        }
+
+        auto [it, inserted] = constantIndex.try_emplace(std::move(encoded), constantCount);
+        if (inserted) {
+            constants += it->first;
+            constantCount++;
+        }
+        return it->second;
+    }
+
+    uint32_t Assembler::NameConstant(std::string_view name) {
+        Operand operand;
+        operand.text = name;
+        return Constant(operand);
+    }
+
+    bool IsSourcePath(std::string_view path) {
+        return path.ends_with(".ny");
+    }
+
+    std::vector<uint8_t> AssembleFile(const std::string& path) {
+        MappedFile file(path);
+        std::span<const uint8_t> bytes = file.Bytes();
+        return Assembler(std::string_view(reinterpret_cast<const char*>(bytes.data()), bytes.size())).Assemble();
+    }
+}
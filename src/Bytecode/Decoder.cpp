@@ -0,0 +1,251 @@
+#include <DotNyet/Bytecode/Decoder.hpp>
+#include <DotNyet/Core/Exceptions.hpp>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <fmt/core.h>
+
+namespace DotNyet::Bytecode {
+
+    using VM::Core::BytecodeFormatException;
+
+    // Upper bound for the number of local slots in a single call frame
+    constexpr uint32_t MaxLocalCount = 1u << 16;
+
+    Image ReadImage(std::span<const uint8_t> file) {
+        constexpr char Magic[4] = {'N', 'Y', 'E', 'T'};
+
+        if (file.size() < 4 || std::memcmp(file.data(), Magic, 4) != 0)
+            return Image{file, FormatVersion1, false};
+        if (file.size() < 5)
+            throw BytecodeFormatException("Invalid bytecode file: missing version byte");
+
+        uint8_t version = file[4];
+        if (version != FormatVersion1 && version != FormatVersion2)
+            throw BytecodeFormatException("Invalid bytecode file: unsupported version " + std::to_string(version));
+        return Image{file.subspan(5), version, true};
+    }
+
+    Decoder::Decoder(std::span<const uint8_t> bytecode, uint8_t version)
+        : bytecode(bytecode), version(version), logger("Bytecode/Decoder") {}
+
+    uint8_t Decoder::ReadUInt8(size_t pos) const {
+        if (pos >= bytecode.size())
+            throw BytecodeFormatException("Unexpected end of bytecode reading uint8");
+        return bytecode[pos];
+    }
+
+    int64_t Decoder::ReadInt64(size_t pos) const {
+        if (pos + 8 > bytecode.size())
+            throw BytecodeFormatException("Unexpected end of bytecode reading int64");
+        int64_t val;
+        std::memcpy(&val, &bytecode[pos], sizeof(int64_t));
+        return val;
+    }
+
+    uint32_t Decoder::ReadUInt32(size_t pos) const {
+        if (pos + 4 > bytecode.size())
+            throw BytecodeFormatException("Unexpected end of bytecode reading uint32");
+        uint32_t val;
+        std::memcpy(&val, &bytecode[pos], sizeof(uint32_t));
+        return val;
+    }
+
+    double Decoder::ReadDouble(size_t pos) const {
+        if (pos + 8 > bytecode.size())
+            throw BytecodeFormatException("Unexpected end of bytecode reading double");
+        double val;
+        std::memcpy(&val, &bytecode[pos], sizeof(double));
+        return val;
+    }
+
+    std::string_view Decoder::ReadString(size_t pos, size_t len) const {
+        if (pos + len > bytecode.size())
+            throw BytecodeFormatException("Unexpected end of bytecode reading string");
+        return std::string_view(reinterpret_cast<const char*>(bytecode.data()) + pos, len);
+    }
+
+    Types::Value Decoder::ReadConstant(size_t& pos) const {
+        auto tag = static_cast<ValueTypeTag>(ReadUInt8(pos++));
+
+        switch (tag) {
+            case ValueTypeTag::Null:
+                return Types::Value();
+            case ValueTypeTag::Integer: {
+                int64_t value = ReadInt64(pos);
+                pos += 8;
+                return Types::Value(value);
+            }
+            case ValueTypeTag::Double: {
+                double value = ReadDouble(pos);
+                pos += 8;
+                return Types::Value(value);
+            }
+            case ValueTypeTag::Boolean:
+                return Types::Value(ReadUInt8(pos++) != 0);
+            case ValueTypeTag::String: {
+                uint32_t len = ReadUInt32(pos);
+                pos += 4;
+                std::string_view text = ReadString(pos, len);
+                pos += len;
+                return Types::Value::FromString(Types::StringObject::Borrow(text));
+            }
+            default:
+                throw BytecodeFormatException(fmt::format("Unknown PUSH ValueTypeTag {}", static_cast<int>(tag)));
+        }
+    }
+
+    uint32_t Decoder::AddConstant(Program& program, Types::Value constant) {
+        auto index = static_cast<uint32_t>(program.constants.size());
+        if (constant.IsString()) {
+            // Share the StringObject of an equal earlier constant, which lets
+            // CMP of two literals succeed on pointer equality
+            auto [it, inserted] = strings.try_emplace(constant.AsString(), index);
+            if (!inserted)
+                constant = program.constants[it->second];
+        }
+        program.constants.push_back(std::move(constant));
+        return index;
+    }
+
+    Program Decoder::Decode() {
+        constexpr uint32_t NoInstruction = std::numeric_limits<uint32_t>::max();
+
+        if (version != FormatVersion1 && version != FormatVersion2)
+            throw BytecodeFormatException(fmt::format("Unsupported bytecode version {}", version));
+
+        Program program;
+        auto& code = program.code;
+        auto& constants = program.constants;
+
+        // Version 2 starts with the constant pool; the code follows it and
+        // all byte offsets (jump targets included) are relative to the code
+        uint32_t poolSize = 0;
+        if (version == FormatVersion2) {
+            poolSize = ReadUInt32(0);
+            size_t poolPos = 4;
+            // Every entry takes at least one byte, which bounds the reservation
+            constants.reserve(std::min<size_t>(poolSize, bytecode.size()));
+            for (uint32_t i = 0; i < poolSize; i++)
+                AddConstant(program, ReadConstant(poolPos));
+            bytecode = bytecode.subspan(poolPos);
+        }
+
+        // Maps the byte offset of every instruction start to its index in `code`,
+        // so jump targets can be resolved once all instructions are known.
+        std::vector<uint32_t> offsetToIndex(bytecode.size() + 1, NoInstruction);
+        std::vector<size_t> jumps;
+        std::vector<std::pair<size_t, std::string>> calls;
+        Function* function = nullptr;
+
+        size_t pos = 0;
+        while (pos < bytecode.size()) {
+            offsetToIndex[pos] = static_cast<uint32_t>(code.size());
+            Instruction ins;
+            ins.op = static_cast<Opcode>(bytecode[pos++]);
+
+            switch (ins.op) {
+                case Opcode::PUSH:
+                    if (version == FormatVersion1) {
+                        ins.operand = AddConstant(program, ReadConstant(pos));
+                    } else {
+                        ins.operand = ReadUInt32(pos);
+                        pos += 4;
+                        if (ins.operand >= poolSize)
+                            throw BytecodeFormatException(fmt::format("PUSH of constant {} outside the pool of {}", ins.operand, poolSize));
+                    }
+                    break;
+
+                case Opcode::DEF:
+                case Opcode::CALL: {
+                    std::string name;
+                    if (version == FormatVersion1) {
+                        uint32_t nameLen = ReadUInt32(pos);
+                        pos += 4;
+                        name = ReadString(pos, nameLen);
+                        pos += nameLen;
+                    } else {
+                        uint32_t index = ReadUInt32(pos);
+                        pos += 4;
+                        if (index >= poolSize || !constants[index].IsString())
+                            throw BytecodeFormatException(fmt::format("Function name {} is not a string constant", index));
+                        name = constants[index].AsString();
+                    }
+
+                    if (ins.op == Opcode::DEF) {
+                        ins.operand = static_cast<uint32_t>(program.functions.size());
+                        program.functionTable[name] = ins.operand;
+                        function = &program.functions.emplace_back(Function{std::move(name), static_cast<uint32_t>(code.size() + 1), 0});
+                    } else {
+                        // Functions may be defined after their callers, resolved below
+                        calls.emplace_back(code.size(), std::move(name));
+                    }
+                    break;
+                }
+
+                case Opcode::STORE:
+                case Opcode::LOAD:
+                    ins.operand = ReadUInt32(pos);
+                    pos += 4;
+
+                    if (ins.operand >= MaxLocalCount)
+                        throw BytecodeFormatException(fmt::format("Local slot {} exceeds the limit of {} slots per function", ins.operand, MaxLocalCount));
+                    if (function)
+                        function->localCount = std::max(function->localCount, ins.operand + 1);
+                    break;
+
+                case Opcode::JMP:
+                case Opcode::JZ:
+                case Opcode::JNZ:
+                    // Byte offset for now, resolved to an instruction index below
+                    ins.operand = ReadUInt32(pos);
+                    pos += 4;
+                    jumps.push_back(code.size());
+                    break;
+
+                case Opcode::HALT:
+                case Opcode::NOP:
+                case Opcode::POP:
+                case Opcode::CMP:
+                case Opcode::PRINT:
+                case Opcode::INPUT:
+                case Opcode::RET:
+                case Opcode::ADD:
+                case Opcode::SUB:
+                case Opcode::MUL:
+                case Opcode::DIV:
+                case Opcode::TOINT:
+                case Opcode::SUBSTR:
+                    break;
+
+                default:
+                    throw BytecodeFormatException(fmt::format("Unknown opcode at offset {}: 0x{:02X}", pos - 1, static_cast<uint8_t>(ins.op)));
+            }
+
+            code.push_back(ins);
+        }
+
+        // Jumping to the very end of the bytecode is allowed and ends execution
+        offsetToIndex[bytecode.size()] = static_cast<uint32_t>(code.size());
+
+        for (size_t index : jumps) {
+            uint32_t target = code[index].operand;
+            if (target > bytecode.size() || offsetToIndex[target] == NoInstruction)
+                throw BytecodeFormatException(fmt::format("Jump target {} is not an instruction boundary", target));
+            code[index].operand = offsetToIndex[target];
+        }
+
+        for (auto& [index, name] : calls) {
+            auto it = program.functionTable.find(name);
+            if (it == program.functionTable.end())
+                throw BytecodeFormatException(fmt::format("Call to unknown function '{}'", name));
+            code[index].operand = it->second;
+        }
+
+        NYET_LOG_DEBUG(logger, "Decoded {} bytes into {} instructions, {} constants and {} functions",
+            bytecode.size(), code.size(), constants.size(), program.functions.size());
+
+        return program;
+    }
+}
@@ -0,0 +1,85 @@
+#include <DotNyet/Bytecode/Fuser.hpp>
+#include <initializer_list>
+#include <vector>
+
+namespace DotNyet::Bytecode {
+
+    Fuser::Fuser(Program& program)
+        : program(program), logger("Bytecode/Fuser") {}
+
+    Fuser::Counts Fuser::Fuse() {
+        auto& code = program.code;
+        Counts counts;
+
+        // Instructions control can arrive at other than by falling through
+        std::vector<bool> entered(code.size() + 1, false);
+        for (const auto& function : program.functions)
+            entered[function.entry] = true;
+        for (const auto& ins : code) {
+            if (ins.op == Opcode::JMP || ins.op == Opcode::JZ || ins.op == Opcode::JNZ)
+                entered[ins.operand] = true;
+        }
+
+        // Whether code[at..] starts with `ops` and nothing jumps past its first instruction
+        auto matches = [&](size_t at, std::initializer_list<Opcode> ops) {
+            if (at + ops.size() > code.size())
+                return false;
+            size_t i = at;
+            for (Opcode op : ops) {
+                if (code[i].op != op || (i != at && entered[i]))
+                    return false;
+                i++;
+            }
+            return true;
+        };
+
+        // Whether the CALL at `at` is followed by RET, directly or through a
+        // STORE r; LOAD r that hands its result back unchanged. The slot dies
+        // with the frame, so it does not matter who else jumps to these.
+        auto returnsResult = [&](size_t at) {
+            if (at + 1 < code.size() && code[at + 1].op == Opcode::RET)
+                return true;
+            return at + 3 < code.size() && code[at + 1].op == Opcode::STORE && code[at + 2].op == Opcode::LOAD &&
+                   code[at + 2].operand == code[at + 1].operand && code[at + 3].op == Opcode::RET;
+        };
+
+        size_t i = 0;
+        while (i < code.size()) {
+            Instruction& ins = code[i];
+
+            if (matches(i, {Opcode::LOAD, Opcode::PUSH, Opcode::ADD, Opcode::STORE}) && code[i + 3].operand == ins.operand) {
+                ins.op = Opcode::ADD_LOCAL_CONST;
+                counts.addLocalConst++;
+                i += 4;
+            } else if (matches(i, {Opcode::LOAD, Opcode::LOAD, Opcode::CMP, Opcode::JNZ})) {
+                ins.op = Opcode::CMP_JNZ_LOCALS;
+                counts.cmpJnzLocals++;
+                i += 4;
+            } else if (matches(i, {Opcode::LOAD, Opcode::PUSH, Opcode::CMP, Opcode::JNZ})) {
+                ins.op = Opcode::CMP_JNZ_LOCAL_CONST;
+                counts.cmpJnzLocalConst++;
+                i += 4;
+            } else if (matches(i, {Opcode::PUSH, Opcode::STORE})) {
+                ins.op = Opcode::LOAD_CONST_STORE;
+                counts.loadConstStore++;
+                i += 2;
+            } else if (matches(i, {Opcode::INPUT, Opcode::TOINT})) {
+                ins.op = Opcode::INPUT_INT;
+                counts.inputInt++;
+                i += 2;
+            } else if (ins.op == Opcode::CALL && returnsResult(i)) {
+                ins.op = Opcode::TAIL_CALL;
+                counts.tailCall++;
+                i++;
+            } else {
+                i++;
+            }
+        }
+
+        NYET_LOG_DEBUG(logger, "Fused {} sequences: ADD_LOCAL_CONST={} CMP_JNZ_LOCALS={} CMP_JNZ_LOCAL_CONST={} LOAD_CONST_STORE={} INPUT_INT={} TAIL_CALL={}",
+            counts.Total(), counts.addLocalConst, counts.cmpJnzLocals, counts.cmpJnzLocalConst, counts.loadConstStore, counts.inputInt,
+            counts.tailCall);
+
+        return counts;
+    }
+}
@@ -0,0 +1,69 @@
+#include <DotNyet/Bytecode/MappedFile.hpp>
+#include <DotNyet/Core/Exceptions.hpp>
+#include <cerrno>
+#include <cstring>
+#include <fmt/core.h>
+
+#if defined(_WIN32)
+#include <fstream>
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace DotNyet::Bytecode {
+
+    using VM::Core::BytecodeFormatException;
+
+#if defined(_WIN32)
+    MappedFile::MappedFile(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            throw BytecodeFormatException("Failed to open bytecode file: " + path);
+
+        buffer.assign(std::istreambuf_iterator<char>(file), {});
+        data = buffer.data();
+        size = buffer.size();
+    }
+
+    MappedFile::~MappedFile() = default;
+#else
+    MappedFile::MappedFile(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            throw BytecodeFormatException("Failed to open bytecode file: " + path);
+
+        struct stat st {};
+        if (::fstat(fd, &st) != 0) {
+            int err = errno;
+            ::close(fd);
+            throw BytecodeFormatException(fmt::format("Failed to stat bytecode file {}: {}", path, std::strerror(err)));
+        }
+
+        size = static_cast<size_t>(st.st_size);
+        // mmap rejects empty mappings; an empty file simply has no bytes
+        if (size > 0) {
+            void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                int err = errno;
+                ::close(fd);
+                throw BytecodeFormatException(fmt::format("Failed to map bytecode file {}: {}", path, std::strerror(err)));
+            }
+            // The decoder reads everything front to back right away
+            ::posix_madvise(mapping, size, POSIX_MADV_WILLNEED);
+            data = static_cast<const uint8_t*>(mapping);
+        }
+
+        // The mapping stays valid after the descriptor is closed
+        ::close(fd);
+    }
+
+    MappedFile::~MappedFile() {
+        if (data)
+            ::munmap(const_cast<uint8_t*>(data), size);
+    }
+#endif
+}
@@ -0,0 +1,586 @@
+#include <DotNyet/Bytecode/Optimizer.hpp>
+#include <DotNyet/Core/Exceptions.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <utility>
+
+namespace DotNyet::Bytecode {
+    using VM::Core::RuntimeException;
+
+    namespace {
+        bool IsJump(Opcode op) {
+            return op == Opcode::JMP || op == Opcode::JZ || op == Opcode::JNZ;
+        }
+
+        // Whether `lhs op rhs` (ADD, SUB or MUL) falls outside int64_t
+        bool Overflows(Opcode op, int64_t lhs, int64_t rhs) {
+            constexpr int64_t min = std::numeric_limits<int64_t>::min();
+            constexpr int64_t max = std::numeric_limits<int64_t>::max();
+            switch (op) {
+                case Opcode::ADD:
+                    return rhs > 0 ? lhs > max - rhs : lhs < min - rhs;
+                case Opcode::SUB:
+                    return rhs < 0 ? lhs > max + rhs : lhs < min + rhs;
+                case Opcode::MUL:
+                    if (lhs == 0 || rhs == 0)
+                        return false;
+                    if (lhs > 0)
+                        return rhs > 0 ? lhs > max / rhs : rhs < min / lhs;
+                    return rhs > 0 ? lhs < min / rhs : lhs < max / rhs;
+                default:
+                    return false;
+            }
+        }
+    }
+
+    Optimizer::Optimizer(Program& program)
+        : program(program), logger("Bytecode/Optimizer") {}
+
+    Optimizer::Counts Optimizer::Optimize() {
+        if (!program.verified)
+            throw RuntimeException("Only verified programs can be optimized");
+
+        counts = Counts{};
+        counts.before = program.code.size();
+        while (counts.rounds < MaxRounds && Round()) {}
+        counts.after = program.code.size();
+
+        NYET_LOG_DEBUG(logger, "Optimized {} instructions to {} in {} rounds: threaded={} propagated={} dead stores={} folded={} branches={} kept on stack={} cancelled={} unreachable={}",
+            counts.before, counts.after, counts.rounds, counts.threaded, counts.propagated, counts.deadStores,
+            counts.folded, counts.branches, counts.stackKept, counts.cancelled, counts.unreachable);
+
+        return counts;
+    }
+
+    // One pass of every rewrite; returns whether anything changed
+    bool Optimizer::Round() {
+        auto& code = program.code;
+        auto total = [this] {
+            return counts.threaded + counts.propagated + counts.deadStores + counts.folded + counts.branches +
+                   counts.stackKept + counts.cancelled + counts.unreachable;
+        };
+        const size_t previous = total();
+        counts.rounds++;
+
+        ThreadJumps();
+        FindBlocks();
+
+        reachable.assign(code.size(), false);
+        known.assign(code.size(), Unseen);
+        readLater.assign(code.size(), false);
+        position.assign(blockStart.size(), Unseen);
+        for (const auto& function : program.functions)
+            Analyze(function);
+
+        removed.assign(code.size(), false);
+        for (uint32_t i = 0; i < code.size(); i++) {
+            Instruction& ins = code[i];
+            if (!reachable[i]) {
+                // DEFs stay: each one sits right before its function's entry
+                if (ins.op != Opcode::DEF) {
+                    Remove(i);
+                    counts.unreachable++;
+                }
+            } else if (ins.op == Opcode::LOAD && known[i] < Varies) {
+                ins = Instruction{Opcode::PUSH, known[i]};
+                counts.propagated++;
+            } else if (ins.op == Opcode::STORE && !readLater[i]) {
+                ins = Instruction{Opcode::POP, 0};
+                counts.deadStores++;
+            }
+        }
+
+        Simplify();
+        Compact();
+        return total() != previous;
+    }
+
+    void Optimizer::ThreadJumps() {
+        auto& code = program.code;
+
+        for (auto& ins : code) {
+            if (!IsJump(ins.op))
+                continue;
+
+            uint32_t target = ins.operand;
+            for (int hops = 0; hops < MaxHops && target < code.size() && code[target].op == Opcode::JMP &&
+                               code[target].operand != target; hops++)
+                target = code[target].operand;
+            // Still on a JMP: the chain is a cycle, which is left as it is
+            if (target < code.size() && code[target].op == Opcode::JMP && code[target].operand != target)
+                target = ins.operand;
+
+            if (target != ins.operand) {
+                ins.operand = target;
+                counts.threaded++;
+            }
+
+            if (ins.op == Opcode::JMP && target < code.size() &&
+                (code[target].op == Opcode::RET || code[target].op == Opcode::HALT)) {
+                ins = code[target];
+                counts.threaded++;
+            }
+        }
+    }
+
+    void Optimizer::FindBlocks() {
+        const auto& code = program.code;
+
+        entered.assign(code.size() + 1, false);
+        std::vector<uint8_t> leader(code.size() + 1, false);
+        leader[0] = true;
+        for (const auto& function : program.functions) {
+            entered[function.entry] = true;
+            leader[function.entry] = true;
+        }
+
+        for (size_t i = 0; i < code.size(); i++) {
+            const Instruction& ins = code[i];
+            if (IsJump(ins.op)) {
+                entered[ins.operand] = true;
+                leader[ins.operand] = true;
+                leader[i + 1] = true;
+            } else if (ins.op == Opcode::RET || ins.op == Opcode::HALT ||
+                       (ins.op == Opcode::CALL && !program.functions[ins.operand].returns)) {
+                leader[i + 1] = true;
+            }
+        }
+
+        blockStart.clear();
+        blockOf.assign(code.size(), 0);
+        for (uint32_t i = 0; i < code.size(); i++) {
+            if (leader[i])
+                blockStart.push_back(i);
+            blockOf[i] = static_cast<uint32_t>(blockStart.size() - 1);
+        }
+    }
+
+    uint32_t Optimizer::BlockEnd(uint32_t block) const {
+        return block + 1 < blockStart.size() ? blockStart[block + 1] : static_cast<uint32_t>(program.code.size());
+    }
+
+    template <typename Visit>
+    void Optimizer::ForEachSuccessor(uint32_t block, Visit&& visit) const {
+        const auto& code = program.code;
+        const uint32_t end = BlockEnd(block);
+        const Instruction& last = code[end - 1];
+
+        // Jumping to or falling off the end of the code finishes execution
+        switch (last.op) {
+            case Opcode::JMP:
+                if (last.operand < code.size())
+                    visit(blockOf[last.operand]);
+                return;
+            case Opcode::JZ:
+            case Opcode::JNZ:
+                if (last.operand < code.size())
+                    visit(blockOf[last.operand]);
+                break;
+            case Opcode::RET:
+            case Opcode::HALT:
+                return;
+            case Opcode::CALL:
+                if (!program.functions[last.operand].returns)
+                    return;
+                break;
+            default:
+                break;
+        }
+        if (end < code.size())
+            visit(block + 1);
+    }
+
+    // Finds the constants each LOAD of `function` reads and which of its
+    // STOREs and LOADs are followed by another read of the slot. Frames are
+    // private to a call, so nothing is live after a RET and no slot holds a
+    // known value at the entry.
+    void Optimizer::Analyze(const Function& function) {
+        const auto& code = program.code;
+        if (function.entry >= code.size())
+            return;
+
+        order.clear();
+        auto reach = [this](uint32_t block) {
+            if (position[block] == Unseen) {
+                position[block] = static_cast<uint32_t>(order.size());
+                order.push_back(block);
+            }
+        };
+        reach(blockOf[function.entry]);
+        for (size_t k = 0; k < order.size(); k++)
+            ForEachSuccessor(order[k], reach);
+
+        for (uint32_t block : order) {
+            for (uint32_t i = blockStart[block]; i < BlockEnd(block); i++)
+                reachable[i] = true;
+        }
+
+        const size_t slots = function.localCount;
+        if (slots == 0 || order.size() * slots > MaxAnalysisCells) {
+            // Assume the worst of every slot
+            for (uint32_t block : order) {
+                for (uint32_t i = blockStart[block]; i < BlockEnd(block); i++) {
+                    if (code[i].op == Opcode::LOAD)
+                        known[i] = Varies;
+                    readLater[i] = true;
+                }
+            }
+        } else {
+            // Forward: the constant each slot holds at the start of each block
+            auto& in = constantsIn;
+            in.assign(order.size() * slots, Varies);
+            seen.assign(order.size(), 0);
+            state.resize(slots);
+            worklist.assign(1, 0);
+            seen[0] = 1;
+
+            // A block's entry state only ever moves from a constant to Varies,
+            // and each block is walked again after its last change, so the
+            // LOADs can be recorded on every walk
+            auto transfer = [&](uint32_t k) {
+                const uint32_t start = blockStart[order[k]];
+                state.assign(in.begin() + k * slots, in.begin() + (k + 1) * slots);
+                for (uint32_t i = start; i < BlockEnd(order[k]); i++) {
+                    const Instruction& ins = code[i];
+                    if (ins.op == Opcode::STORE) {
+                        uint32_t value = Varies;
+                        if (i > start && code[i - 1].op == Opcode::PUSH)
+                            value = code[i - 1].operand;
+                        else if (i > start && code[i - 1].op == Opcode::LOAD)
+                            value = state[code[i - 1].operand];
+                        state[ins.operand] = value;
+                    } else if (ins.op == Opcode::LOAD) {
+                        const uint32_t value = state[ins.operand];
+                        if (known[i] == Unseen)
+                            known[i] = value;
+                        else if (known[i] != value)
+                            known[i] = Varies;
+                    }
+                }
+            };
+
+            while (!worklist.empty()) {
+                uint32_t k = worklist.back();
+                worklist.pop_back();
+                transfer(k);
+                ForEachSuccessor(order[k], [&](uint32_t block) {
+                    const uint32_t s = position[block];
+                    uint32_t* target = in.data() + s * slots;
+                    if (!seen[s]) {
+                        seen[s] = 1;
+                        std::copy(state.begin(), state.end(), target);
+                        worklist.push_back(s);
+                        return;
+                    }
+                    bool changed = false;
+                    for (size_t j = 0; j < slots; j++) {
+                        if (target[j] != state[j] && target[j] != Varies) {
+                            target[j] = Varies;
+                            changed = true;
+                        }
+                    }
+                    if (changed)
+                        worklist.push_back(s);
+                });
+            }
+
+            // Backward: the slots read again at the start of each block
+            const size_t words = (slots + 63) / 64;
+            liveIn.assign(order.size() * words, 0);
+            live.resize(words);
+
+            // Live sets only grow, so a read seen on any sweep is seen on the last
+            bool changed = true;
+            while (changed) {
+                changed = false;
+                for (uint32_t k = static_cast<uint32_t>(order.size()); k-- > 0;) {
+                    std::fill(live.begin(), live.end(), 0);
+                    ForEachSuccessor(order[k], [&](uint32_t block) {
+                        const uint64_t* from = liveIn.data() + position[block] * words;
+                        for (size_t w = 0; w < words; w++)
+                            live[w] |= from[w];
+                    });
+                    for (uint32_t i = BlockEnd(order[k]); i-- > blockStart[order[k]];) {
+                        const Instruction& ins = code[i];
+                        if (ins.op != Opcode::STORE && ins.op != Opcode::LOAD)
+                            continue;
+                        const uint64_t bit = uint64_t{1} << (ins.operand % 64);
+                        uint64_t& word = live[ins.operand / 64];
+                        if (word & bit)
+                            readLater[i] = true;
+                        if (ins.op == Opcode::STORE)
+                            word &= ~bit;
+                        else
+                            word |= bit;
+                    }
+                    uint64_t* to = liveIn.data() + k * words;
+                    if (!std::equal(live.begin(), live.end(), to)) {
+                        std::copy(live.begin(), live.end(), to);
+                        changed = true;
+                    }
+                }
+            }
+        }
+
+        for (uint32_t block : order)
+            position[block] = Unseen;
+    }
+
+    void Optimizer::Simplify() {
+        auto& code = program.code;
+        const auto size = static_cast<uint32_t>(code.size());
+
+        // Where a jump to `target` lands once the removed instructions are gone
+        auto landing = [&](uint32_t target) {
+            return target < size && removed[target] ? Next(target) : target;
+        };
+
+        uint32_t i = 0;
+        while (i < size) {
+            if (removed[i]) {
+                i++;
+                continue;
+            }
+
+            Instruction& ins = code[i];
+            const uint32_t next = Next(i);
+            // The instruction after this one, if only this one leads to it
+            const Instruction* follower = next < size && !entered[next] ? &code[next] : nullptr;
+
+            switch (ins.op) {
+                case Opcode::NOP:
+                    Remove(i);
+                    counts.cancelled++;
+                    break;
+
+                case Opcode::PUSH:
+                    if (Fold(i))
+                        continue; // the result may fold again with what follows
+                    if (!follower)
+                        break;
+                    if (follower->op == Opcode::POP) {
+                        Remove(i);
+                        Remove(next);
+                        counts.cancelled++;
+                    } else if (follower->op == Opcode::JZ || follower->op == Opcode::JNZ) {
+                        bool taken = program.constants[ins.operand].IsTruthy() == (follower->op == Opcode::JNZ);
+                        if (taken)
+                            ins = Instruction{Opcode::JMP, follower->operand};
+                        else
+                            Remove(i);
+                        Remove(next);
+                        counts.branches++;
+                    }
+                    break;
+
+                case Opcode::LOAD:
+                    if (follower && (follower->op == Opcode::POP ||
+                                     (follower->op == Opcode::STORE && follower->operand == ins.operand))) {
+                        Remove(i);
+                        Remove(next);
+                        counts.cancelled++;
+                    }
+                    break;
+
+                case Opcode::STORE:
+                    if (follower && follower->op == Opcode::LOAD && follower->operand == ins.operand && !readLater[next]) {
+                        Remove(i);
+                        Remove(next);
+                        counts.stackKept++;
+                    }
+                    break;
+
+                case Opcode::JMP:
+                    if (landing(ins.operand) == next) {
+                        Remove(i);
+                        counts.cancelled++;
+                    }
+                    break;
+
+                case Opcode::JZ:
+                case Opcode::JNZ:
+                    // The condition still has to go
+                    if (landing(ins.operand) == next) {
+                        ins = Instruction{Opcode::POP, 0};
+                        counts.cancelled++;
+                    }
+                    break;
+
+                default:
+                    break;
+            }
+            i++;
+        }
+    }
+
+    // Evaluates the PUSH at `at` together with the instructions that consume
+    // it, if they can be evaluated now. Operands are taken from the stack the
+    // way the interpreter's handlers take them.
+    bool Optimizer::Fold(uint32_t at) {
+        auto& code = program.code;
+        const auto& constants = program.constants;
+        const auto size = static_cast<uint32_t>(code.size());
+
+        // The instruction after `from`, if only `from` leads to it
+        auto follow = [&](uint32_t from) -> uint32_t {
+            uint32_t next = Next(from);
+            return next < size && !entered[next] ? next : size;
+        };
+
+        const uint32_t second = follow(at);
+        if (second == size)
+            return false;
+
+        try {
+            if (code[second].op == Opcode::TOINT) {
+                const Types::Value& value = constants[code[at].operand];
+                if (!value.IsInt()) {
+                    // Out of range doubles have no defined conversion
+                    if (value.IsDouble() && !(std::abs(value.AsDouble()) < 9.2e18))
+                        return false;
+                    code[at].operand = AddConstant(Types::Value(Types::ToInt(value)));
+                }
+                Remove(second);
+                counts.folded++;
+                return true;
+            }
+
+            if (code[second].op != Opcode::PUSH)
+                return false;
+            const uint32_t third = follow(second);
+            if (third == size)
+                return false;
+
+            const Types::Value& below = constants[code[at].operand];
+            const Types::Value& top = constants[code[second].operand];
+            std::optional<Types::Value> result;
+
+            switch (code[third].op) {
+                case Opcode::ADD:
+                    if (below.IsInt() && top.IsInt() && Overflows(Opcode::ADD, below.AsInt(), top.AsInt()))
+                        return false;
+                    result = below + top;
+                    break;
+                case Opcode::SUB:
+                    if (top.IsInt() && below.IsInt() && Overflows(Opcode::SUB, top.AsInt(), below.AsInt()))
+                        return false;
+                    result = top - below;
+                    break;
+                case Opcode::MUL:
+                    if (top.IsInt() && below.IsInt() && Overflows(Opcode::MUL, top.AsInt(), below.AsInt()))
+                        return false;
+                    result = top * below;
+                    break;
+                case Opcode::DIV:
+                    if (top.IsInt() && below.IsInt() && top.AsInt() == std::numeric_limits<int64_t>::min() && below.AsInt() == -1)
+                        return false;
+                    result = top / below;
+                    break;
+                case Opcode::CMP:
+                    result = Types::Value(Types::Equals(below, top));
+                    break;
+                case Opcode::PUSH: {
+                    const uint32_t fourth = follow(third);
+                    if (fourth == size || code[fourth].op != Opcode::SUBSTR)
+                        return false;
+                    code[at].operand = AddConstant(Types::Substr(below, top, constants[code[third].operand]));
+                    Remove(second);
+                    Remove(third);
+                    Remove(fourth);
+                    counts.folded++;
+                    return true;
+                }
+                default:
+                    return false;
+            }
+
+            code[at].operand = AddConstant(std::move(*result));
+            Remove(second);
+            Remove(third);
+            counts.folded++;
+            return true;
+        } catch (const VM::Core::VMException&) {
+            // It fails at run time, and keeps doing so
+            return false;
+        }
+    }
+
+    void Optimizer::Compact() {
+        auto& code = program.code;
+
+        // Removed instructions map to the next one that stays
+        std::vector<uint32_t> index(code.size() + 1);
+        uint32_t kept = 0;
+        for (uint32_t i = 0; i < code.size(); i++) {
+            index[i] = kept;
+            if (!removed[i])
+                code[kept++] = code[i];
+        }
+        index[code.size()] = kept;
+        code.resize(kept);
+
+        for (auto& ins : code) {
+            if (IsJump(ins.op))
+                ins.operand = index[ins.operand];
+        }
+        for (auto& function : program.functions)
+            function.entry = index[function.entry];
+    }
+
+    // The first instruction after `at` that has not been removed, or the end
+    uint32_t Optimizer::Next(uint32_t at) const {
+        const auto size = static_cast<uint32_t>(program.code.size());
+        uint32_t next = at + 1;
+        while (next < size && removed[next])
+            next++;
+        return next;
+    }
+
+    void Optimizer::Remove(uint32_t at) {
+        removed[at] = true;
+        // Control that arrived here continues with whatever comes next
+        if (entered[at])
+            entered[Next(at)] = true;
+    }
+
+    uint32_t Optimizer::AddConstant(Types::Value value) {
+        auto& constants = program.constants;
+        if (constantIndex.empty()) {
+            for (uint32_t i = 0; i < constants.size(); i++)
+                constantIndex.try_emplace(ConstantKey(constants[i]), i);
+        }
+
+        auto [it, inserted] = constantIndex.try_emplace(ConstantKey(value), static_cast<uint32_t>(constants.size()));
+        if (inserted)
+            constants.push_back(std::move(value));
+        return it->second;
+    }
+
+    std::string Optimizer::ConstantKey(const Types::Value& value) {
+        std::string key(1, static_cast<char>(value.Type()));
+        switch (value.Type()) {
+            case Types::ValueType::Integer: {
+                int64_t i = value.AsInt();
+                key.append(reinterpret_cast<const char*>(&i), sizeof(i));
+                break;
+            }
+            case Types::ValueType::Double: {
+                // Bit for bit, so 0.0 and -0.0 stay apart
+                double d = value.AsDouble();
+                key.append(reinterpret_cast<const char*>(&d), sizeof(d));
+                break;
+            }
+            case Types::ValueType::Boolean:
+                key.push_back(value.AsBool() ? '\1' : '\0');
+                break;
+            case Types::ValueType::String:
+                key.append(value.AsString());
+                break;
+            default:
+                break;
+        }
+        return key;
+    }
+}
@@ -0,0 +1,313 @@
+#include <DotNyet/Bytecode/Snapshot.hpp>
+#include <DotNyet/Core/Exceptions.hpp>
+#include <bit>
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+#include <fmt/core.h>
+
+namespace DotNyet::Bytecode {
+
+    using VM::Core::BytecodeFormatException;
+
+    namespace {
+        constexpr char Magic[8] = {'N', 'Y', 'E', 'T', 'S', 'N', 'A', 'P'};
+
+        // Byte layout of the file. Every section starts at a multiple of 8.
+        //   header     HeaderSize bytes, see below
+        //   code       codeCount x 8:      op, 3 zero bytes, operand
+        //   constants  constantCount x 16: tag, 3 zero bytes, length, payload
+        //   stack      stackCount x 16:    like constants
+        //   functions  functionCount x 32: name offset, name length, entry,
+        //              localCount, arguments, effect, returns, 7 zero bytes
+        //   strings    the characters of every distinct string, back to back
+        // String payloads and function names are offsets into `strings`.
+        constexpr size_t HeaderSize = 64;
+        constexpr size_t InstructionSize = 8;
+        constexpr size_t ValueSize = 16;
+        constexpr size_t FunctionSize = 32;
+
+        struct Header {
+            char magic[8];
+            uint32_t version;
+            uint32_t flags;
+            uint64_t fingerprint;
+            uint64_t checksum; // of everything after the header
+            uint32_t codeCount;
+            uint32_t constantCount;
+            uint32_t stackCount;
+            uint32_t functionCount;
+            uint64_t stringsSize;
+            uint64_t reserved;
+        };
+        static_assert(sizeof(Header) == HeaderSize);
+
+        constexpr uint32_t FlagVerified = 1u << 0;
+
+        constexpr uint64_t FnvOffset = 0xCBF29CE484222325ull;
+        constexpr uint64_t FnvPrime = 0x100000001B3ull;
+
+        // FNV-1a over 8-byte words, which is fast enough to check a file on
+        // every load
+        uint64_t Checksum(std::span<const uint8_t> bytes) {
+            uint64_t hash = FnvOffset;
+            size_t i = 0;
+            for (; i + 8 <= bytes.size(); i += 8) {
+                uint64_t word;
+                std::memcpy(&word, bytes.data() + i, 8);
+                hash = (hash ^ word) * FnvPrime;
+            }
+            for (; i < bytes.size(); i++)
+                hash = (hash ^ bytes[i]) * FnvPrime;
+            return hash;
+        }
+
+        // Tells builds apart whose snapshots would not mean the same thing:
+        // opcode numbering and the byte order of the host
+        uint64_t Fingerprint() {
+            static const uint64_t fingerprint = [] {
+                uint64_t hash = FnvOffset ^ SnapshotVersion;
+                for (unsigned op = 0; op < 256; op++) {
+                    for (const char* c = Name(static_cast<Opcode>(op)); *c; c++)
+                        hash = (hash ^ static_cast<uint8_t>(*c)) * FnvPrime;
+                    hash = (hash ^ op) * FnvPrime;
+                }
+                return hash ^ static_cast<uint64_t>(std::endian::native == std::endian::little);
+            }();
+            return fingerprint;
+        }
+
+        template <typename T>
+        void Put(std::vector<uint8_t>& out, size_t at, T value) {
+            std::memcpy(out.data() + at, &value, sizeof(T));
+        }
+
+        template <typename T>
+        T Get(std::span<const uint8_t> in, size_t at) {
+            T value;
+            std::memcpy(&value, in.data() + at, sizeof(T));
+            return value;
+        }
+
+        // Collects the strings section, storing each distinct string once
+        class StringTable {
+        public:
+            uint32_t Add(std::string_view text) {
+                auto [it, inserted] = offsets.try_emplace(text, static_cast<uint32_t>(bytes.size()));
+                if (inserted) {
+                    if (bytes.size() + text.size() > UINT32_MAX)
+                        throw VM::Core::RuntimeException("Snapshot strings exceed 4 GiB");
+                    bytes.append(text);
+                }
+                return it->second;
+            }
+
+            const std::string& Bytes() const {
+                return bytes;
+            }
+
+        private:
+            std::string bytes;
+            // Views into the program and stack being written, which outlive the table
+            std::unordered_map<std::string_view, uint32_t> offsets;
+        };
+
+        void PutValue(std::vector<uint8_t>& out, size_t at, const Types::Value& value, StringTable& strings) {
+            ValueTypeTag tag;
+            uint32_t length = 0;
+            uint64_t payload = 0;
+            switch (value.Type()) {
+                case Types::ValueType::Null:
+                    tag = ValueTypeTag::Null;
+                    break;
+                case Types::ValueType::Integer:
+                    tag = ValueTypeTag::Integer;
+                    payload = static_cast<uint64_t>(value.AsInt());
+                    break;
+                case Types::ValueType::Double:
+                    tag = ValueTypeTag::Double;
+                    payload = std::bit_cast<uint64_t>(value.AsDouble());
+                    break;
+                case Types::ValueType::Boolean:
+                    tag = ValueTypeTag::Boolean;
+                    payload = value.AsBool() ? 1 : 0;
+                    break;
+                case Types::ValueType::String: {
+                    std::string_view text = value.AsString();
+                    if (text.size() > UINT32_MAX)
+                        throw VM::Core::RuntimeException("String too long for a snapshot");
+                    tag = ValueTypeTag::String;
+                    length = static_cast<uint32_t>(text.size());
+                    payload = strings.Add(text);
+                    break;
+                }
+                default:
+                    throw VM::Core::RuntimeException("Cannot store an uninitialized value in a snapshot");
+            }
+            Put(out, at, static_cast<uint8_t>(tag));
+            Put(out, at + 4, length);
+            Put(out, at + 8, payload);
+        }
+
+        // Restores values whose strings borrow from `strings`; equal strings
+        // share one StringObject, as the Decoder would have it
+        class ValueReader {
+        public:
+            explicit ValueReader(std::string_view strings) : strings(strings) {}
+
+            Types::Value Read(std::span<const uint8_t> in, size_t at) {
+                auto tag = static_cast<ValueTypeTag>(Get<uint8_t>(in, at));
+                auto length = Get<uint32_t>(in, at + 4);
+                auto payload = Get<uint64_t>(in, at + 8);
+                switch (tag) {
+                    case ValueTypeTag::Null:
+                        return Types::Value();
+                    case ValueTypeTag::Integer:
+                        return Types::Value(static_cast<int64_t>(payload));
+                    case ValueTypeTag::Double:
+                        return Types::Value(std::bit_cast<double>(payload));
+                    case ValueTypeTag::Boolean:
+                        return Types::Value(payload != 0);
+                    case ValueTypeTag::String: {
+                        if (payload > strings.size() || length > strings.size() - payload || payload > UINT32_MAX)
+                            throw BytecodeFormatException("Invalid snapshot: string outside the strings section");
+                        auto [it, inserted] = shared.try_emplace(payload << 32 | length);
+                        if (inserted)
+                            it->second = Types::Value::FromString(Types::StringObject::Borrow(strings.substr(payload, length)));
+                        return it->second;
+                    }
+                    default:
+                        throw BytecodeFormatException(fmt::format("Invalid snapshot: unknown value tag {}", static_cast<int>(tag)));
+                }
+            }
+
+        private:
+            std::string_view strings;
+            // (offset << 32 | length) -> the value made for that string
+            std::unordered_map<uint64_t, Types::Value> shared;
+        };
+    }
+
+    bool IsSnapshot(std::span<const uint8_t> file) {
+        return file.size() >= sizeof(Magic) && std::memcmp(file.data(), Magic, sizeof(Magic)) == 0;
+    }
+
+    std::vector<uint8_t> WriteSnapshot(const Program& program, std::span<const Instruction> code,
+                                       std::span<const Types::Value> stack) {
+        const size_t codeAt = HeaderSize;
+        const size_t constantsAt = codeAt + code.size() * InstructionSize;
+        const size_t stackAt = constantsAt + program.constants.size() * ValueSize;
+        const size_t functionsAt = stackAt + stack.size() * ValueSize;
+        const size_t stringsAt = functionsAt + program.functions.size() * FunctionSize;
+
+        std::vector<uint8_t> out(stringsAt, 0);
+        StringTable strings;
+
+        for (size_t i = 0; i < code.size(); i++) {
+            Put(out, codeAt + i * InstructionSize, static_cast<uint8_t>(code[i].op));
+            Put(out, codeAt + i * InstructionSize + 4, code[i].operand);
+        }
+        for (size_t i = 0; i < program.constants.size(); i++)
+            PutValue(out, constantsAt + i * ValueSize, program.constants[i], strings);
+        for (size_t i = 0; i < stack.size(); i++)
+            PutValue(out, stackAt + i * ValueSize, stack[i], strings);
+        for (size_t i = 0; i < program.functions.size(); i++) {
+            const Function& function = program.functions[i];
+            size_t at = functionsAt + i * FunctionSize;
+            Put(out, at, strings.Add(function.name));
+            Put(out, at + 4, static_cast<uint32_t>(function.name.size()));
+            Put(out, at + 8, function.entry);
+            Put(out, at + 12, function.localCount);
+            Put(out, at + 16, function.arguments);
+            Put(out, at + 20, function.effect);
+            Put(out, at + 24, static_cast<uint8_t>(function.returns));
+        }
+        out.insert(out.end(), strings.Bytes().begin(), strings.Bytes().end());
+
+        Header header {};
+        std::memcpy(header.magic, Magic, sizeof(Magic));
+        header.version = SnapshotVersion;
+        header.flags = program.verified ? FlagVerified : 0;
+        header.fingerprint = Fingerprint();
+        header.codeCount = static_cast<uint32_t>(code.size());
+        header.constantCount = static_cast<uint32_t>(program.constants.size());
+        header.stackCount = static_cast<uint32_t>(stack.size());
+        header.functionCount = static_cast<uint32_t>(program.functions.size());
+        header.stringsSize = strings.Bytes().size();
+        header.checksum = Checksum(std::span<const uint8_t>(out).subspan(HeaderSize));
+        std::memcpy(out.data(), &header, sizeof(header));
+        return out;
+    }
+
+    Snapshot ReadSnapshot(std::span<const uint8_t> file, std::shared_ptr<const void> owner) {
+        if (!IsSnapshot(file))
+            throw BytecodeFormatException("Invalid snapshot: missing NYETSNAP magic");
+        if (file.size() < HeaderSize)
+            throw BytecodeFormatException("Invalid snapshot: truncated header");
+
+        Header header;
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (header.version != SnapshotVersion)
+            throw BytecodeFormatException(fmt::format("Unsupported snapshot version {}", header.version));
+        if (header.fingerprint != Fingerprint())
+            throw BytecodeFormatException("Snapshot was written by an incompatible build of the VM");
+
+        const size_t codeAt = HeaderSize;
+        const size_t constantsAt = codeAt + size_t{header.codeCount} * InstructionSize;
+        const size_t stackAt = constantsAt + size_t{header.constantCount} * ValueSize;
+        const size_t functionsAt = stackAt + size_t{header.stackCount} * ValueSize;
+        const size_t stringsAt = functionsAt + size_t{header.functionCount} * FunctionSize;
+        if (stringsAt > file.size() || header.stringsSize != file.size() - stringsAt)
+            throw BytecodeFormatException("Invalid snapshot: truncated or oversized sections");
+        if (Checksum(file.subspan(HeaderSize)) != header.checksum)
+            throw BytecodeFormatException("Invalid snapshot: checksum mismatch");
+
+        std::string_view strings(reinterpret_cast<const char*>(file.data()) + stringsAt, header.stringsSize);
+        // The constants end up frozen (see VirtualMachine::Prepare), so the
+        // stack gets string objects of its own
+        ValueReader constants(strings);
+        ValueReader values(strings);
+
+        Snapshot snapshot;
+        Program& program = snapshot.program;
+        program.storage = std::move(owner);
+        program.verified = (header.flags & FlagVerified) != 0;
+
+        program.code.resize(header.codeCount);
+        for (size_t i = 0; i < program.code.size(); i++) {
+            program.code[i].op = static_cast<Opcode>(Get<uint8_t>(file, codeAt + i * InstructionSize));
+            program.code[i].operand = Get<uint32_t>(file, codeAt + i * InstructionSize + 4);
+        }
+
+        program.constants.reserve(header.constantCount);
+        for (size_t i = 0; i < header.constantCount; i++)
+            program.constants.push_back(constants.Read(file, constantsAt + i * ValueSize));
+
+        snapshot.stack.reserve(header.stackCount);
+        for (size_t i = 0; i < header.stackCount; i++)
+            snapshot.stack.push_back(values.Read(file, stackAt + i * ValueSize));
+
+        program.functions.reserve(header.functionCount);
+        program.functionTable.reserve(header.functionCount);
+        for (uint32_t i = 0; i < header.functionCount; i++) {
+            size_t at = functionsAt + size_t{i} * FunctionSize;
+            auto nameAt = Get<uint32_t>(file, at);
+            auto nameLength = Get<uint32_t>(file, at + 4);
+            if (nameAt > strings.size() || nameLength > strings.size() - nameAt)
+                throw BytecodeFormatException("Invalid snapshot: function name outside the strings section");
+
+            Function function;
+            function.name = strings.substr(nameAt, nameLength);
+            function.entry = Get<uint32_t>(file, at + 8);
+            function.localCount = Get<uint32_t>(file, at + 12);
+            function.arguments = Get<uint32_t>(file, at + 16);
+            function.effect = Get<int32_t>(file, at + 20);
+            function.returns = Get<uint8_t>(file, at + 24) != 0;
+            if (function.entry > program.code.size())
+                throw BytecodeFormatException(fmt::format("Invalid snapshot: function '{}' starts outside the code", function.name));
+            program.functionTable[function.name] = i;
+            program.functions.push_back(std::move(function));
+        }
+        return snapshot;
+    }
+}
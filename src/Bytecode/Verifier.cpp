@@ -0,0 +1,264 @@
+#include <DotNyet/Bytecode/Verifier.hpp>
+#include <DotNyet/Core/Exceptions.hpp>
+#include <algorithm>
+#include <fmt/core.h>
+
+namespace DotNyet::Bytecode {
+
+    using VM::Core::VerificationException;
+
+    Verifier::Verifier(Program& program)
+        : program(program), logger("Bytecode/Verifier") {}
+
+    void Verifier::FindBlocks() {
+        const auto& code = program.code;
+
+        std::vector<bool> leader(code.size() + 1, false);
+        leader[0] = true;
+        for (const auto& function : program.functions)
+            leader[function.entry] = true;
+
+        for (size_t i = 0; i < code.size(); i++) {
+            switch (code[i].op) {
+                case Opcode::JMP:
+                case Opcode::JZ:
+                case Opcode::JNZ:
+                    leader[code[i].operand] = true;
+                    leader[i + 1] = true;
+                    break;
+                case Opcode::RET:
+                case Opcode::HALT:
+                    leader[i + 1] = true;
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        blocks.clear();
+        blockOf.assign(code.size(), 0);
+        for (uint32_t i = 0; i < code.size(); i++) {
+            if (leader[i]) {
+                if (!blocks.empty())
+                    blocks.back().end = i;
+                blocks.push_back(Block{i, static_cast<uint32_t>(code.size())});
+            }
+            blockOf[i] = static_cast<uint32_t>(blocks.size() - 1);
+        }
+    }
+
+    Verifier::Summary Verifier::Analyze(const Function& function) {
+        const auto& code = program.code;
+        const size_t words = (function.localCount + 63) / 64;
+
+        // Forget what the previous analysis learned
+        for (uint32_t block : reached)
+            states[block].reached = false;
+        reached.clear();
+
+        std::vector<uint32_t> worklist;
+        Summary summary;
+        int64_t lowest = 0;
+
+        auto propagate = [&](uint32_t target, int64_t depth, const std::vector<uint64_t>& assigned) {
+            uint32_t block = blockOf[target];
+            BlockState& state = states[block];
+
+            if (!state.reached) {
+                state.reached = true;
+                reached.push_back(block);
+                state.depth = depth;
+                state.assigned = assigned;
+                worklist.push_back(block);
+                return;
+            }
+
+            if (state.depth != depth)
+                throw VerificationException(fmt::format("Instruction {} in '{}' is reached with stack depths {} and {}",
+                    target, function.name, state.depth, depth));
+
+            bool changed = false;
+            for (size_t w = 0; w < words; w++) {
+                uint64_t merged = state.assigned[w] & assigned[w];
+                changed |= merged != state.assigned[w];
+                state.assigned[w] = merged;
+            }
+            if (changed)
+                worklist.push_back(block);
+        };
+
+        if (function.entry < code.size())
+            propagate(function.entry, 0, std::vector<uint64_t>(words, 0));
+
+        while (!worklist.empty()) {
+            uint32_t block = worklist.back();
+            worklist.pop_back();
+
+            int64_t depth = states[block].depth;
+            std::vector<uint64_t> assigned = states[block].assigned;
+            bool fallsThrough = true;
+
+            // Pops `count` values and records how far below the entry depth that reaches
+            auto take = [&](int64_t count) {
+                depth -= count;
+                lowest = std::min(lowest, depth);
+            };
+
+            auto checkSlot = [&](uint32_t at, uint32_t slot) {
+                if (slot >= function.localCount)
+                    throw VerificationException(fmt::format("Slot {} at instruction {} is outside the frame of '{}' ({} slots)",
+                        slot, at, function.name, function.localCount));
+            };
+
+            for (uint32_t i = blocks[block].start; i < blocks[block].end && fallsThrough; i++) {
+                const Instruction& ins = code[i];
+
+                switch (ins.op) {
+                    case Opcode::NOP:
+                    case Opcode::DEF:
+                        break;
+
+                    case Opcode::PUSH:
+                    case Opcode::INPUT:
+                        depth++;
+                        break;
+
+                    case Opcode::POP:
+                    case Opcode::PRINT:
+                        take(1);
+                        break;
+
+                    case Opcode::TOINT:
+                        take(1);
+                        depth++;
+                        break;
+
+                    case Opcode::CMP:
+                    case Opcode::ADD:
+                    case Opcode::SUB:
+                    case Opcode::MUL:
+                    case Opcode::DIV:
+                        take(2);
+                        depth++;
+                        break;
+
+                    case Opcode::SUBSTR:
+                        take(3);
+                        depth++;
+                        break;
+
+                    case Opcode::STORE:
+                        checkSlot(i, ins.operand);
+                        take(1);
+                        assigned[ins.operand / 64] |= uint64_t{1} << (ins.operand % 64);
+                        break;
+
+                    case Opcode::LOAD:
+                        checkSlot(i, ins.operand);
+                        if (!(assigned[ins.operand / 64] & (uint64_t{1} << (ins.operand % 64))))
+                            throw VerificationException(fmt::format("LOAD at instruction {} in '{}' may read slot {} before it is stored",
+                                i, function.name, ins.operand));
+                        depth++;
+                        break;
+
+                    case Opcode::JMP:
+                        // Jumping to the end of the code finishes execution
+                        if (ins.operand < code.size())
+                            propagate(ins.operand, depth, assigned);
+                        fallsThrough = false;
+                        break;
+
+                    case Opcode::JZ:
+                    case Opcode::JNZ:
+                        take(1);
+                        if (ins.operand < code.size())
+                            propagate(ins.operand, depth, assigned);
+                        break;
+
+                    case Opcode::HALT:
+                        fallsThrough = false;
+                        break;
+
+                    case Opcode::RET:
+                        // The return value stays on the stack for the caller
+                        take(1);
+                        depth++;
+                        if (summary.returns && summary.effect != depth)
+                            throw VerificationException(fmt::format("RET at instruction {} in '{}' leaves a stack depth of {}, another RET leaves {}",
+                                i, function.name, depth, summary.effect));
+                        summary.returns = true;
+                        summary.effect = depth;
+                        fallsThrough = false;
+                        break;
+
+                    case Opcode::CALL: {
+                        const Summary& callee = summaries[ins.operand];
+                        take(callee.arguments);
+                        depth += callee.arguments;
+                        // Nothing after a call to a function that never returns can run
+                        if (callee.returns)
+                            depth += callee.effect;
+                        else
+                            fallsThrough = false;
+                        break;
+                    }
+
+                    default:
+                        throw VerificationException(fmt::format("Unexpected opcode 0x{:02X} at instruction {}", static_cast<uint8_t>(ins.op), i));
+                }
+            }
+
+            // Falling off the end of the code finishes execution
+            if (fallsThrough && blocks[block].end < code.size())
+                propagate(blocks[block].end, depth, assigned);
+        }
+
+        summary.arguments = -lowest;
+        return summary;
+    }
+
+    void Verifier::Verify() {
+        program.verified = false;
+        if (program.code.empty()) {
+            program.verified = true;
+            return;
+        }
+
+        FindBlocks();
+        summaries.assign(program.functions.size(), Summary{});
+        states.assign(blocks.size(), BlockState{});
+        reached.clear();
+
+        // Each function's summary depends on those of its callees, so iterate
+        // until nothing changes. Recursion is handled by treating a callee
+        // without a summary yet as never returning; the summaries only grow.
+        // A program whose consumption keeps growing (e.g. a function that pops
+        // before calling itself) would never settle, hence the bound below.
+        const int64_t limit = 3 * static_cast<int64_t>(program.code.size()) + 3;
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (size_t f = 0; f < program.functions.size(); f++) {
+                Summary summary = Analyze(program.functions[f]);
+                if (summary.arguments > limit)
+                    throw VerificationException(fmt::format("Function '{}' consumes an unbounded number of stack values",
+                        program.functions[f].name));
+                if (summary != summaries[f]) {
+                    summaries[f] = summary;
+                    changed = true;
+                }
+            }
+        }
+
+        for (size_t f = 0; f < program.functions.size(); f++) {
+            program.functions[f].arguments = static_cast<uint32_t>(summaries[f].arguments);
+            program.functions[f].returns = summaries[f].returns;
+            program.functions[f].effect = static_cast<int32_t>(summaries[f].effect);
+            NYET_LOG_DEBUG(logger, "Function '{}': consumes {} values, returns {}", program.functions[f].name,
+                summaries[f].arguments, summaries[f].returns ? fmt::format("with a stack effect of {}", summaries[f].effect) : "never");
+        }
+
+        program.verified = true;
+        NYET_LOG_DEBUG(logger, "Verified {} instructions in {} blocks", program.code.size(), blocks.size());
+    }
+}
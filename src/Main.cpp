@@ -1,31 +1,62 @@
 #include <Util/Log.hpp>
 #include <DotNyet/VM/VirtualMachine.hpp>
+#include <DotNyet/VM/BatchRunner.hpp>
 #include <DotNyet/Core/Exceptions.hpp>
 #include <DotNyet/Bytecode/Opcodes.hpp>
+#include <DotNyet/Bytecode/MappedFile.hpp>
+#include <DotNyet/Bytecode/Decoder.hpp>
+#include <DotNyet/Bytecode/Assembler.hpp>
+#include <DotNyet/Bytecode/Snapshot.hpp>
+#include <DotNyet/Bytecode/Verifier.hpp>
+#include <DotNyet/Bytecode/Optimizer.hpp>
+#include <DotNyet/AOT/CppEmitter.hpp>
+#include <fmt/core.h>
 
-#include <fstream>
 #include <print>
 #include <vector>
 #include <string>
 #include <exception>
 #include <typeinfo>
 #include <cstring>
+#include <cstdlib>
+#include <cstdint>
 #include <memory>
+#include <span>
+#include <optional>
+#include <utility>
+#include <fstream>
+#include <iostream>
+#include <iterator>
 #include <Util/Demangle.hpp>
 #include <getopt.h>
 
-constexpr char NYET_MAGIC[4] = {'N', 'Y', 'E', 'T'};
-constexpr uint8_t NYET_VERSION = 0x01;
-
 Util::Logger logger("Main");
 
 void print_usage(const char* prog_name) {
-    std::printf("Usage: %s [options] <bytecode file> [-- args...]\n", prog_name);
+    std::printf("Usage: %s [options] <bytecode or .ny source file> [-- args...]\n", prog_name);
+    std::printf("       %s --batch [options] <bytecode file> [input files...] [-- args...]\n", prog_name);
     std::printf("Options:\n");
     std::printf("  -h, --help             Show this help message and exit\n");
     std::printf("  -v, --version          Show version information and exit\n");
     std::printf("  -l, --log-level=LEVEL  Set logging level (debug, info, warn, error)\n");
-    std::printf("  -n, --no-verify        Disable bytecode verification\n");
+    std::printf("  -n, --no-verify        Skip the bytecode verifier (runtime checks stay on)\n");
+    std::printf("      --no-optimize      Run the program as decoded, without the bytecode optimizer\n");
+    std::printf("      --opt-stats        Print what the optimizer and the fuser did to stderr\n");
+    std::printf("  -j, --jit              Compile hot functions to machine code\n");
+    std::printf("      --jit-threshold=N  Calls plus backward jumps before a function is compiled (default %u)\n",
+        DotNyet::VM::Jit::DefaultThreshold);
+    std::printf("      --max-call-depth=N\n");
+    std::printf("                         Calls active at once before a stack overflow (default %u);\n",
+        DotNyet::VM::VirtualMachine::DefaultMaxCallDepth);
+    std::printf("                         a CALL right before RET reuses the caller's frame\n");
+    std::printf("      --emit-cpp=FILE    Translate the program to C++ in FILE instead of running it\n");
+    std::printf("  -p, --profile=FILE     Print a profile to stderr at exit and write its call stacks\n");
+    std::printf("                         to FILE in collapsed (flamegraph) format\n");
+    std::printf("      --snapshot=FILE    After running, write the loaded and warmed-up program to FILE;\n");
+    std::printf("                         dotnyet runs such a snapshot like a bytecode file\n");
+    std::printf("  -b, --batch            Run the program once per input file, or once per line of\n");
+    std::printf("                         standard input, in parallel; outputs are printed in order\n");
+    std::printf("      --jobs=N           Threads for --batch (default: one per hardware thread)\n");
 }
 
 void print_version() {
@@ -37,41 +68,195 @@ void print_version() {
     std::printf("There is NO WARRANTY, to the extent permitted by law.\n");
 }
 
-void prog(const std::string& filename, const std::string& args = "", bool verify_bytecode = true) {
-    using namespace DotNyet::VM::Core;
+struct RunOptions {
+    bool verify_bytecode = true;
+    bool optimize = true;
+    bool opt_stats = false;
+    bool jit = false;
+    uint32_t jit_threshold = DotNyet::VM::Jit::DefaultThreshold;
+    uint32_t max_call_depth = DotNyet::VM::VirtualMachine::DefaultMaxCallDepth;
+    std::string emit_cpp;
+    std::string profile;
+    std::string snapshot;
+    bool batch = false;
+    unsigned jobs = 0;
+    std::vector<std::string> inputs; // --batch input files
+};
 
-    std::ifstream file(filename, std::ios::binary);
-    if (!file) {
-        throw BytecodeFormatException("Failed to open bytecode file: " + filename);
+void write_profile(const DotNyet::VM::VirtualMachine& vm, const std::string& path) {
+    const DotNyet::VM::Profiler* profiler = vm.GetProfiler();
+    if (!profiler)
+        return;
+
+    std::fputs(profiler->Summary().c_str(), stderr);
+    std::string stacks = profiler->CollapsedStacks();
+    std::ofstream out(path, std::ios::binary);
+    if (!out || !out.write(stacks.data(), static_cast<std::streamsize>(stacks.size())))
+        logger.Error("Could not write profile to {}", path);
+}
+
+// Reads the records of a --batch run: the contents of each input file, or
+// else every line of standard input
+std::vector<std::string> read_batch_inputs(const std::vector<std::string>& files) {
+    std::vector<std::string> records;
+    if (!files.empty()) {
+        for (const auto& path : files) {
+            std::ifstream in(path, std::ios::binary);
+            if (!in)
+                throw DotNyet::VM::Core::RuntimeException("Could not read " + path);
+            records.emplace_back(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+        return records;
     }
 
-    if (verify_bytecode) {
-        char magic[4];
-        file.read(magic, 4);
-        if (file.gcount() != 4 || std::memcmp(magic, NYET_MAGIC, 4) != 0) {
-            logger.Warn("Invalid bytecode file: missing NYET magic header, proceeding without verification");
-            file.seekg(0, std::ios::beg);
-        } else {
-            uint8_t version = 0;
-            file.read(reinterpret_cast<char*>(&version), 1);
-            if (file.gcount() != 1 || version != NYET_VERSION) {
-                logger.Warn("Invalid bytecode file: unsupported version {}, proceeding without verification", version);
-                file.seekg(4, std::ios::beg);
-            }
+    std::string line;
+    while (std::getline(std::cin, line))
+        records.push_back(std::move(line));
+    return records;
+}
+
+// The bytes of the program in `filename` and their owner: a .nyet file or
+// snapshot as it is, or the image assembled from a .ny source file
+std::pair<std::span<const uint8_t>, std::shared_ptr<const void>> read_program(const std::string& filename) {
+    if (DotNyet::Bytecode::IsSourcePath(filename)) {
+        auto image = std::make_shared<const std::vector<uint8_t>>(DotNyet::Bytecode::AssembleFile(filename));
+        return {std::span<const uint8_t>(*image), image};
+    }
+    auto file = std::make_shared<const DotNyet::Bytecode::MappedFile>(filename);
+    return {file->Bytes(), file};
+}
+
+// `optimized` is empty if the optimizer did not run
+void print_optimizer_counts(const std::optional<DotNyet::Bytecode::Optimizer::Counts>& optimized) {
+    if (!optimized) {
+        fmt::print(stderr, "Optimizer: off\n");
+        return;
+    }
+    const auto& counts = *optimized;
+    double saved = counts.before ? 100.0 * static_cast<double>(counts.before - counts.after) / static_cast<double>(counts.before) : 0.0;
+    fmt::print(stderr, "Optimizer: {} -> {} instructions ({:.1f}% fewer) in {} rounds\n", counts.before, counts.after, saved, counts.rounds);
+    fmt::print(stderr, "  jumps threaded        {}\n", counts.threaded);
+    fmt::print(stderr, "  constants propagated  {}\n", counts.propagated);
+    fmt::print(stderr, "  dead stores           {}\n", counts.deadStores);
+    fmt::print(stderr, "  operations folded     {}\n", counts.folded);
+    fmt::print(stderr, "  branches resolved     {}\n", counts.branches);
+    fmt::print(stderr, "  values kept on stack  {}\n", counts.stackKept);
+    fmt::print(stderr, "  no-ops dropped        {}\n", counts.cancelled);
+    fmt::print(stderr, "  unreachable dropped   {}\n", counts.unreachable);
+}
+
+void print_prepare_stats(const DotNyet::VM::VirtualMachine::PrepareStats& stats) {
+    if (!stats.fused) {
+        fmt::print(stderr, "Snapshots are loaded as they were saved, without optimizing or fusing them\n");
+        return;
+    }
+    print_optimizer_counts(stats.optimized);
+    const auto& fused = *stats.fused;
+    fmt::print(stderr, "Fuser: {} superinstructions\n", fused.Total());
+    fmt::print(stderr, "  ADD_LOCAL_CONST       {}\n", fused.addLocalConst);
+    fmt::print(stderr, "  CMP_JNZ_LOCALS        {}\n", fused.cmpJnzLocals);
+    fmt::print(stderr, "  CMP_JNZ_LOCAL_CONST   {}\n", fused.cmpJnzLocalConst);
+    fmt::print(stderr, "  LOAD_CONST_STORE      {}\n", fused.loadConstStore);
+    fmt::print(stderr, "  INPUT_INT             {}\n", fused.inputInt);
+    fmt::print(stderr, "  TAIL_CALL             {}\n", fused.tailCall);
+}
+
+int batch(const std::string& filename, const std::string& args, const RunOptions& options) {
+    auto [bytes, owner] = read_program(filename);
+    DotNyet::VM::VirtualMachine::PrepareStats stats;
+    auto program = DotNyet::VM::VirtualMachine::PrepareImage(bytes, owner, options.verify_bytecode, options.optimize, &stats);
+    if (options.opt_stats)
+        print_prepare_stats(stats);
+
+    std::vector<std::string> records = read_batch_inputs(options.inputs);
+
+    DotNyet::VM::BatchRunner runner(program, options.jobs);
+    runner.SetArguments(args);
+    runner.SetSetup([&options](DotNyet::VM::VirtualMachine& vm) {
+        vm.SetMaxCallDepth(options.max_call_depth);
+        if (options.jit) {
+            vm.SetJit(true);
+            vm.SetJitThreshold(options.jit_threshold);
+        }
+    });
+    logger.Info("Running {} jobs on {} threads", records.size(), runner.GetThreads());
+
+    size_t failed = runner.Run(records, [&](size_t job, DotNyet::VM::BatchRunner::Result& result) {
+        std::fwrite(result.output.data(), 1, result.output.size(), stdout);
+        if (!result.error)
+            return;
+        std::string source = options.inputs.empty() ? "line " + std::to_string(job + 1) : options.inputs[job];
+        try {
+            std::rethrow_exception(result.error);
+        } catch (const std::exception& e) {
+            logger.Error("Job {} ({}) failed [{}]: {}", job + 1, source, demangle(typeid(e).name()).c_str(), e.what());
+        }
+    });
+    std::fflush(stdout);
+
+    if (failed)
+        logger.Error("{} of {} jobs failed", failed, records.size());
+    return failed ? 1 : 0;
+}
+
+void prog(const std::string& filename, const std::string& args, const RunOptions& options) {
+    using namespace DotNyet::VM::Core;
+
+    if (!options.emit_cpp.empty()) {
+        auto [bytes, owner] = read_program(filename);
+        if (DotNyet::Bytecode::IsSnapshot(bytes))
+            throw RuntimeException("--emit-cpp translates bytecode files, not snapshots");
+        DotNyet::Bytecode::Image image = DotNyet::Bytecode::ReadImage(bytes);
+        if (!image.hasHeader)
+            logger.Warn("Invalid bytecode file: missing NYET magic header, reading it as version 1 code");
+
+        DotNyet::Bytecode::Program program = DotNyet::Bytecode::Decoder(image.bytecode, image.version).Decode();
+        program.storage = owner;
+        DotNyet::Bytecode::Verifier(program).Verify();
+        std::optional<DotNyet::Bytecode::Optimizer::Counts> counts;
+        if (options.optimize) {
+            counts = DotNyet::Bytecode::Optimizer(program).Optimize();
+            DotNyet::Bytecode::Verifier(program).Verify();
         }
+        if (options.opt_stats)
+            print_optimizer_counts(counts);
+
+        std::string source = DotNyet::AOT::CppEmitter(program).Emit(filename);
+        std::ofstream out(options.emit_cpp, std::ios::binary);
+        if (!out || !out.write(source.data(), static_cast<std::streamsize>(source.size())))
+            throw RuntimeException("Could not write " + options.emit_cpp);
+        return;
     }
 
-    std::vector<uint8_t> program(std::istreambuf_iterator<char>(file), {});
     DotNyet::VM::VirtualMachine vm;
-    vm.LoadBytecode(std::move(program));
+    vm.SetVerification(options.verify_bytecode);
+    vm.SetOptimization(options.optimize);
+    vm.SetMaxCallDepth(options.max_call_depth);
+    if (options.jit) {
+        vm.SetJit(true);
+        vm.SetJitThreshold(options.jit_threshold);
+    }
+    vm.SetProfiling(!options.profile.empty());
+    vm.LoadFile(filename);
+    if (options.opt_stats)
+        print_prepare_stats(vm.GetPrepareStats());
 
-    if (!args.empty()) {
-        vm.GetStack().Push(DotNyet::Types::Value(args));
-    } else {
-        vm.GetStack().Push(DotNyet::Types::Value(std::string()));
+    try {
+        vm.Run(args);
+    } catch (...) {
+        write_profile(vm, options.profile);
+        throw;
     }
+    write_profile(vm, options.profile);
 
-    vm.Run();
+    if (!options.snapshot.empty()) {
+        // Whatever main left behind is not part of the next run
+        vm.GetStack().DropTop(vm.GetStack().Size());
+        std::vector<uint8_t> snapshot = vm.SaveSnapshot();
+        std::ofstream out(options.snapshot, std::ios::binary);
+        if (!out || !out.write(reinterpret_cast<const char*>(snapshot.data()), static_cast<std::streamsize>(snapshot.size())))
+            throw RuntimeException("Could not write " + options.snapshot);
+    }
 }
 
 int main(int argc, char* argv[]) {
@@ -80,15 +265,25 @@ int main(int argc, char* argv[]) {
         {"version", no_argument, 0, 'v'},
         {"log-level", required_argument, 0, 'l'},
         {"no-verify", no_argument, 0, 'n'},
+        {"no-optimize", no_argument, 0, 'O'},
+        {"opt-stats", no_argument, 0, 'P'},
+        {"jit", no_argument, 0, 'j'},
+        {"jit-threshold", required_argument, 0, 'T'},
+        {"max-call-depth", required_argument, 0, 'D'},
+        {"emit-cpp", required_argument, 0, 'C'},
+        {"profile", required_argument, 0, 'p'},
+        {"snapshot", required_argument, 0, 'S'},
+        {"batch", no_argument, 0, 'b'},
+        {"jobs", required_argument, 0, 'J'},
         {0, 0, 0, 0}
     };
 
     int opt;
-    bool verify_bytecode = true;
+    RunOptions options;
     std::string filename;
     std::string argString;
 
-    while ((opt = getopt_long(argc, argv, "hvl:n", long_options, nullptr)) != -1) {
+    while ((opt = getopt_long(argc, argv, "hvl:njp:b", long_options, nullptr)) != -1) {
         switch (opt) {
             case 'h':
                 print_usage(argv[0]);
@@ -101,6 +296,8 @@ int main(int argc, char* argv[]) {
                     std::string level(optarg);
                     if (level == "debug") {
                         Util::Logger::SetLogLevel(Util::Logger::Level::Debug);
+                        if (!Util::Logger::IsCompiledIn(Util::Logger::Level::Debug))
+                            logger.Warn("Debug logging is compiled out of this build (see DOTNYET_LOG_MIN_LEVEL)");
                     } else if (level == "info") {
                         Util::Logger::SetLogLevel(Util::Logger::Level::Info);
                     } else if (level == "warn") {
@@ -114,7 +311,61 @@ int main(int argc, char* argv[]) {
                 }
                 break;
             case 'n':
-                verify_bytecode = false;
+                options.verify_bytecode = false;
+                break;
+            case 'O':
+                options.optimize = false;
+                break;
+            case 'P':
+                options.opt_stats = true;
+                break;
+            case 'j':
+                options.jit = true;
+                break;
+            case 'T':
+                {
+                    char* end = nullptr;
+                    unsigned long threshold = std::strtoul(optarg, &end, 10);
+                    if (*optarg == '\0' || *end != '\0' || threshold == 0 || threshold > UINT32_MAX) {
+                        logger.Error("Invalid JIT threshold: {}", optarg);
+                        return 1;
+                    }
+                    options.jit_threshold = static_cast<uint32_t>(threshold);
+                }
+                break;
+            case 'D':
+                {
+                    char* end = nullptr;
+                    unsigned long depth = std::strtoul(optarg, &end, 10);
+                    if (*optarg == '\0' || *end != '\0' || depth == 0 || depth > UINT32_MAX) {
+                        logger.Error("Invalid maximum call depth: {}", optarg);
+                        return 1;
+                    }
+                    options.max_call_depth = static_cast<uint32_t>(depth);
+                }
+                break;
+            case 'C':
+                options.emit_cpp = optarg;
+                break;
+            case 'p':
+                options.profile = optarg;
+                break;
+            case 'S':
+                options.snapshot = optarg;
+                break;
+            case 'b':
+                options.batch = true;
+                break;
+            case 'J':
+                {
+                    char* end = nullptr;
+                    unsigned long jobs = std::strtoul(optarg, &end, 10);
+                    if (*optarg == '\0' || *end != '\0' || jobs == 0 || jobs > 4096) {
+                        logger.Error("Invalid number of jobs: {}", optarg);
+                        return 1;
+                    }
+                    options.jobs = static_cast<unsigned>(jobs);
+                }
                 break;
             default:
                 print_usage(argv[0]);
@@ -129,6 +380,8 @@ int main(int argc, char* argv[]) {
                 afterDoubleDash = true;
             } else if (filename.empty()) {
                 filename = argv[i];
+            } else if (options.batch) {
+                options.inputs.push_back(argv[i]);
             } else {
                 logger.Error("Unexpected argument before --: {}", argv[i]);
                 return 1;
@@ -145,8 +398,20 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
+    if (!options.emit_cpp.empty() && !options.verify_bytecode) {
+        logger.Error("--emit-cpp only translates verified programs and cannot be combined with --no-verify");
+        return 1;
+    }
+
+    if (options.batch && (!options.emit_cpp.empty() || !options.profile.empty() || !options.snapshot.empty())) {
+        logger.Error("--batch cannot be combined with --emit-cpp, --profile or --snapshot");
+        return 1;
+    }
+
     try {
-        prog(filename, argString, verify_bytecode);
+        if (options.batch)
+            return batch(filename, argString, options);
+        prog(filename, argString, options);
     } catch (const std::exception& e) {
         logger.Error("Exception caught [{}]: {}", demangle(typeid(e).name()).c_str(), e.what());
         return 1;
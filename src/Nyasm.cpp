@@ -0,0 +1,31 @@
+#include <Util/Log.hpp>
+#include <DotNyet/Bytecode/Assembler.hpp>
+#include <DotNyet/Core/Exceptions.hpp>
+
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// nyasm: compiles .ny assembly source to .nyet bytecode, like tools/dotnyet.py
+
+Util::Logger logger("nyasm");
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::printf("Usage: %s <input.ny> <output.nyet>\n", argv[0]);
+        return 1;
+    }
+
+    try {
+        std::vector<uint8_t> image = DotNyet::Bytecode::AssembleFile(argv[1]);
+        std::ofstream out(argv[2], std::ios::binary);
+        if (!out || !out.write(reinterpret_cast<const char*>(image.data()), static_cast<std::streamsize>(image.size())))
+            throw DotNyet::VM::Core::RuntimeException(std::string("Could not write ") + argv[2]);
+    } catch (const std::exception& e) {
+        logger.Error("{}: {}", argv[1], e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include <DotNyet/Types/String.hpp>
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace DotNyet::Types {
+
+    // Smallest buffer an appended-to string grows to
+    constexpr size_t MinAppendCapacity = 32;
+
+    StringObject* StringObject::Allocate(size_t size, size_t capacity) {
+        void* memory = ::operator new(sizeof(StringObject) + capacity);
+        auto* inlineData = static_cast<const char*>(memory) + sizeof(StringObject);
+        return new (memory) StringObject(size, capacity, inlineData);
+    }
+
+    void StringObject::Destroy(StringObject* str) {
+        str->~StringObject();
+        ::operator delete(str);
+    }
+
+    StringObject* StringObject::Create(std::string_view text) {
+        StringObject* str = Allocate(text.size(), text.size());
+        if (!text.empty())
+            std::memcpy(str->MutableData(), text.data(), text.size());
+        return str;
+    }
+
+    StringObject* StringObject::Concat(std::string_view lhs, std::string_view rhs) {
+        StringObject* str = Allocate(lhs.size() + rhs.size(), lhs.size() + rhs.size());
+        if (!lhs.empty())
+            std::memcpy(str->MutableData(), lhs.data(), lhs.size());
+        if (!rhs.empty())
+            std::memcpy(str->MutableData() + lhs.size(), rhs.data(), rhs.size());
+        return str;
+    }
+
+    StringObject* StringObject::Borrow(std::string_view text) {
+        void* memory = ::operator new(sizeof(StringObject));
+        return new (memory) StringObject(text.size(), 0, text.data());
+    }
+
+    StringObject* StringObject::Append(StringObject* str, std::string_view text) {
+        size_t needed = str->size + text.size();
+
+        if (str->refs == 1 && !str->IsBorrowed()) {
+            if (needed <= str->capacity) {
+                // `text` may point into this string, but never past its end
+                if (!text.empty())
+                    std::memcpy(str->MutableData() + str->size, text.data(), text.size());
+                str->size = needed;
+                return str;
+            }
+
+            StringObject* grown = Allocate(needed, std::max({needed, str->capacity * 2, MinAppendCapacity}));
+            if (str->size)
+                std::memcpy(grown->MutableData(), str->Data(), str->size);
+            if (!text.empty())
+                std::memcpy(grown->MutableData() + str->size, text.data(), text.size());
+            Destroy(str);
+            return grown;
+        }
+
+        // Shared or borrowed: leave it untouched and give the result room to grow
+        StringObject* result = Allocate(needed, std::max(needed, MinAppendCapacity));
+        if (str->size)
+            std::memcpy(result->MutableData(), str->Data(), str->size);
+        if (!text.empty())
+            std::memcpy(result->MutableData() + str->size, text.data(), text.size());
+        str->Release();
+        return result;
+    }
+}
@@ -1,85 +1,36 @@
 #include <DotNyet/Types/Value.hpp>
+#include <charconv>
 
 namespace DotNyet::Types {
 
-    Value::Value(int64_t i) : data(i) {}
-    Value::Value(double d) : data(d) {}
-    Value::Value(bool b) : data(b) {}
-    Value::Value(const std::string& s) : data(s) {}
-
-    ValueType Value::Type() const {
-        if (std::holds_alternative<std::monostate>(data)) return ValueType::Null;
-        if (std::holds_alternative<int64_t>(data)) return ValueType::Integer;
-        if (std::holds_alternative<double>(data)) return ValueType::Double;
-        if (std::holds_alternative<bool>(data)) return ValueType::Boolean;
-        if (std::holds_alternative<std::string>(data)) return ValueType::String;
-        return ValueType::Unknown;
+    void Value::ThrowTypeMismatch(const char* msg) {
+        throw DotNyet::VM::Core::TypeException(msg);
     }
 
     std::string Value::ToString() const {
-        switch (Type()) {
+        switch (type) {
             case ValueType::Null:
                 return "null";
             case ValueType::Integer:
-                return std::to_string(std::get<int64_t>(data));
+                return std::to_string(as.i);
             case ValueType::Double:
-                return std::to_string(std::get<double>(data));
+                return std::to_string(as.d);
             case ValueType::Boolean:
-                return std::get<bool>(data) ? "true" : "false";
+                return as.b ? "true" : "false";
             case ValueType::String:
-                return std::get<std::string>(data);
+                return std::string(as.s->View());
             default:
                 return "<unknown>";
         }
     }
 
-    bool Value::IsNull() const {
-        return std::holds_alternative<std::monostate>(data);
-    }
-
-    bool Value::IsInt() const {
-        return std::holds_alternative<int64_t>(data);
-    }
-
-    bool Value::IsDouble() const {
-        return std::holds_alternative<double>(data);
-    }
-
-    bool Value::IsBool() const {
-        return std::holds_alternative<bool>(data);
-    }
-
-    bool Value::IsString() const {
-        return std::holds_alternative<std::string>(data);
-    }
-
-    int64_t Value::AsInt() const {
-        if (!IsInt()) throw DotNyet::VM::Core::TypeException("Value is not an int");
-        return std::get<int64_t>(data);
-    }
-
-    double Value::AsDouble() const {
-        if (!IsDouble()) throw DotNyet::VM::Core::TypeException("Value is not a double");
-        return std::get<double>(data);
-    }
-
-    bool Value::AsBool() const {
-        if (!IsBool()) throw DotNyet::VM::Core::TypeException("Value is not a bool");
-        return std::get<bool>(data);
-    }
-
-    const std::string& Value::AsString() const {
-        if (!IsString()) throw DotNyet::VM::Core::TypeException("Value is not a string");
-        return std::get<std::string>(data);
-    }
-
     bool Value::IsTruthy() const {
-        switch (Type()) {
+        switch (type) {
             case ValueType::Null: return false;
-            case ValueType::Boolean: return data.index() == 3 && std::get<bool>(data);
-            case ValueType::Integer: return data.index() == 1 && std::get<int64_t>(data) != 0;
-            case ValueType::Double: return data.index() == 2 && std::get<double>(data) != 0.0;
-            case ValueType::String: return data.index() == 4 && !std::get<std::string>(data).empty();
+            case ValueType::Boolean: return as.b;
+            case ValueType::Integer: return as.i != 0;
+            case ValueType::Double: return as.d != 0.0;
+            case ValueType::String: return as.s->Size() != 0;
             default: return false;
         }
     }
@@ -102,23 +53,23 @@ namespace DotNyet::Types {
         }
         
         if (lhs.IsString() && rhs.IsString()) {
-            return Value(lhs.AsString() + rhs.AsString());
+            return Value::FromString(StringObject::Concat(lhs.AsString(), rhs.AsString()));
         }
 
         if (lhs.IsString() && rhs.IsInt()) {
-            return Value(lhs.AsString() + std::to_string(rhs.AsInt()));
+            return Value::FromString(StringObject::Concat(lhs.AsString(), std::to_string(rhs.AsInt())));
         }
         
         if (lhs.IsString() && rhs.IsDouble()) {
-            return Value(lhs.AsString() + std::to_string(rhs.AsDouble()));
+            return Value::FromString(StringObject::Concat(lhs.AsString(), std::to_string(rhs.AsDouble())));
         }
 
         if (lhs.IsDouble() && rhs.IsString()) {
-            return Value(std::to_string(lhs.AsDouble()) + rhs.AsString());
+            return Value::FromString(StringObject::Concat(std::to_string(lhs.AsDouble()), rhs.AsString()));
         }
 
         if (lhs.IsInt() && rhs.IsString()) {
-            return Value(std::to_string(lhs.AsInt()) + rhs.AsString());
+            return Value::FromString(StringObject::Concat(std::to_string(lhs.AsInt()), rhs.AsString()));
         }
 
         throw DotNyet::VM::Core::RuntimeException(fmt::format(
@@ -197,6 +148,63 @@ namespace DotNyet::Types {
         ));
     }
 
+    bool Equals(const Value& lhs, const Value& rhs) {
+        if (lhs.Type() != rhs.Type())
+            throw DotNyet::VM::Core::RuntimeException("Cannot compare different types");
+
+        if (lhs.IsInt())
+            return lhs.AsInt() == rhs.AsInt();
+        if (lhs.IsDouble())
+            return lhs.AsDouble() == rhs.AsDouble();
+        if (lhs.IsString()) {
+            // Equal literals share a StringObject (see Bytecode::Decoder)
+            return lhs.AsStringObject() == rhs.AsStringObject() || lhs.AsString() == rhs.AsString();
+        }
+        throw DotNyet::VM::Core::RuntimeException("Unsupported comparison types");
+    }
+
+    int64_t ToInt(const Value& value) {
+        if (value.IsInt())
+            return value.AsInt();
+        if (value.IsDouble())
+            return static_cast<int64_t>(value.AsDouble());
+        if (value.IsString())
+            return ParseInt(value.AsString());
+        throw DotNyet::VM::Core::RuntimeException("Unsupported type for TOINT");
+    }
+
+    int64_t ParseInt(std::string_view text) {
+        size_t pos = text.find_first_not_of(" \t\n\v\f\r");
+        if (pos == std::string_view::npos)
+            throw DotNyet::VM::Core::RuntimeException("Invalid string for conversion to int");
+        // from_chars accepts '-' but not '+'
+        if (text[pos] == '+' && pos + 1 < text.size() && text[pos + 1] != '-')
+            pos++;
+
+        int64_t value = 0;
+        auto result = std::from_chars(text.data() + pos, text.data() + text.size(), value);
+        if (result.ec == std::errc::invalid_argument)
+            throw DotNyet::VM::Core::RuntimeException("Invalid string for conversion to int");
+        if (result.ec == std::errc::result_out_of_range)
+            throw DotNyet::VM::Core::RuntimeException("String is out of range for conversion to int");
+        return value;
+    }
+
+    Value Substr(const Value& str, const Value& start, const Value& end) {
+        if (!str.IsString() || !start.IsInt() || !end.IsInt())
+            throw DotNyet::VM::Core::RuntimeException("SUBSTR expects a string and two integers");
+
+        std::string_view text = str.AsString();
+        int64_t startIdx = start.AsInt();
+        int64_t endIdx = end.AsInt();
+
+        if (startIdx < 0 || endIdx < 0 || startIdx >= static_cast<int64_t>(text.size()) ||
+            endIdx > static_cast<int64_t>(text.size()) || startIdx > endIdx)
+            throw DotNyet::VM::Core::RuntimeException("Invalid indices for SUBSTR");
+
+        return Value(text.substr(startIdx, endIdx - startIdx));
+    }
+
     std::ostream& operator<<(std::ostream& os, const Value& val) {
         os << val.ToString();
         return os;
@@ -0,0 +1,147 @@
+#include <DotNyet/VM/BatchRunner.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <string_view>
+#include <thread>
+
+namespace DotNyet::VM {
+
+    namespace {
+        // The jobs [next, end) a worker has yet to run. The owner takes from the
+        // front and thieves split off the back, so both rarely want the same
+        // job. Each queue sits on a cache line of its own.
+        struct alignas(64) Queue {
+            std::mutex lock;
+            size_t next = 0;
+            size_t end = 0;
+        };
+    }
+
+    BatchRunner::BatchRunner(std::shared_ptr<const Bytecode::Program> program, unsigned threads)
+        : program(std::move(program)), threads(threads ? threads : std::max(1u, std::thread::hardware_concurrency())) {}
+
+    void BatchRunner::SetSetup(Setup function) {
+        setup = std::move(function);
+    }
+
+    void BatchRunner::SetArguments(std::string text) {
+        arguments = std::move(text);
+    }
+
+    unsigned BatchRunner::GetThreads() const {
+        return threads;
+    }
+
+    size_t BatchRunner::Run(const std::vector<std::string>& inputs, const Emit& emit) {
+        const size_t jobs = inputs.size();
+        if (jobs == 0)
+            return 0;
+        const size_t workers = std::min<size_t>(threads, jobs);
+
+        std::vector<Queue> queues(workers);
+        for (size_t w = 0; w < workers; w++) {
+            queues[w].next = jobs * w / workers;
+            queues[w].end = jobs * (w + 1) / workers;
+        }
+
+        std::vector<Result> results(jobs);
+        std::vector<uint8_t> done(jobs, 0);
+        std::mutex emitLock;
+        size_t emitted = 0;
+        std::atomic<size_t> failed = 0;
+        std::exception_ptr error; // the first thing that went wrong outside a job
+
+        auto take = [&](size_t self, size_t& job) {
+            {
+                std::lock_guard<std::mutex> guard(queues[self].lock);
+                if (queues[self].next < queues[self].end) {
+                    job = queues[self].next++;
+                    return true;
+                }
+            }
+            for (size_t k = 1; k < workers; k++) {
+                Queue& victim = queues[(self + k) % workers];
+                size_t begin, end;
+                {
+                    std::lock_guard<std::mutex> guard(victim.lock);
+                    size_t left = victim.end - victim.next;
+                    if (left == 0)
+                        continue;
+                    end = victim.end;
+                    begin = end - (left + 1) / 2;
+                    victim.end = begin;
+                }
+                std::lock_guard<std::mutex> guard(queues[self].lock);
+                queues[self].next = begin + 1;
+                queues[self].end = end;
+                job = begin;
+                return true;
+            }
+            return false;
+        };
+
+        // Hands out every finished job no earlier job is still holding back
+        auto finish = [&](size_t job) {
+            std::lock_guard<std::mutex> guard(emitLock);
+            done[job] = 1;
+            while (emitted < jobs && done[emitted]) {
+                if (!error) {
+                    try {
+                        emit(emitted, results[emitted]);
+                    } catch (...) {
+                        error = std::current_exception();
+                    }
+                }
+                results[emitted] = Result();
+                emitted++;
+            }
+        };
+
+        auto work = [&](size_t self) {
+            try {
+                VirtualMachine vm;
+                if (setup)
+                    setup(vm);
+                vm.Load(program);
+
+                size_t job;
+                while (take(self, job)) {
+                    Result& result = results[job];
+                    vm.GetOutput().RedirectTo([&result](std::string_view text) { result.output.append(text); });
+                    vm.GetInput().RedirectTo([input = std::string_view(inputs[job])](char* buffer, size_t size) mutable {
+                        size_t count = std::min(size, input.size());
+                        std::memcpy(buffer, input.data(), count);
+                        input.remove_prefix(count);
+                        return count;
+                    });
+                    try {
+                        vm.Run(arguments);
+                    } catch (...) {
+                        result.error = std::current_exception();
+                        failed++;
+                    }
+                    finish(job);
+                }
+            } catch (...) {
+                // Any jobs left in this worker's queue are stolen by the others
+                std::lock_guard<std::mutex> guard(emitLock);
+                if (!error)
+                    error = std::current_exception();
+            }
+        };
+
+        std::vector<std::thread> pool;
+        pool.reserve(workers - 1);
+        for (size_t w = 1; w < workers; w++)
+            pool.emplace_back(work, w);
+        work(0);
+        for (auto& thread : pool)
+            thread.join();
+
+        if (error)
+            std::rethrow_exception(error);
+        return failed;
+    }
+}
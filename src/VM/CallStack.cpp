@@ -0,0 +1,65 @@
+#include <DotNyet/VM/CallStack.hpp>
+#include <algorithm>
+
+namespace DotNyet::VM {
+
+    CallStack::Frame& CallStack::Push(size_t returnIp, uint32_t function, uint32_t size) {
+        uint32_t chunk = top ? top->chunk : 0;
+        Types::Value* values = Allocate(size, chunk);
+
+        if (depth == frames.size() * FramesPerChunk)
+            frames.push_back(std::make_unique<Frame[]>(FramesPerChunk));
+        top = &frames[depth / FramesPerChunk][depth % FramesPerChunk];
+        depth++;
+        *top = Frame{returnIp, values, size, function, chunk};
+        return *top;
+    }
+
+    size_t CallStack::Pop() {
+        size_t returnIp = top->returnIp;
+        Release(*top);
+        depth--;
+        top = depth ? &frames[(depth - 1) / FramesPerChunk][(depth - 1) % FramesPerChunk] : nullptr;
+        return returnIp;
+    }
+
+    CallStack::Frame& CallStack::Replace(uint32_t function, uint32_t size) {
+        Release(*top);
+        top->slots = Allocate(size, top->chunk);
+        top->size = size;
+        top->function = function;
+        return *top;
+    }
+
+    void CallStack::Clear() {
+        while (depth)
+            Pop();
+    }
+
+    Types::Value* CallStack::Allocate(uint32_t size, uint32_t& chunk) {
+        for (;; chunk++) {
+            if (chunk == slots.size())
+                slots.emplace_back();
+            SlotChunk& slot = slots[chunk];
+            if (slot.capacity - slot.used >= size) {
+                Types::Value* values = slot.values.get() + slot.used;
+                slot.used += size;
+                return values;
+            }
+            // Chunks past the innermost frame's are empty, and one too small
+            // for this frame is replaced rather than skipped
+            if (slot.used == 0) {
+                slot.capacity = std::max(SlotsPerChunk, size);
+                slot.values = std::make_unique<Types::Value[]>(slot.capacity);
+                std::fill_n(slot.values.get(), slot.capacity, Types::Value::Uninitialized());
+                slot.used = size;
+                return slot.values.get();
+            }
+        }
+    }
+
+    void CallStack::Release(const Frame& frame) {
+        std::fill_n(frame.slots, frame.size, Types::Value::Uninitialized());
+        slots[frame.chunk].used -= frame.size;
+    }
+}
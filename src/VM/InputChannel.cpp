@@ -0,0 +1,97 @@
+#include <DotNyet/VM/InputChannel.hpp>
+#include <cerrno>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace DotNyet::VM {
+
+    InputChannel::InputChannel()
+        : buffer(std::make_unique<char[]>(BlockSize)) {}
+
+    InputChannel::~InputChannel() = default;
+
+    void InputChannel::Reset() {
+        start = 0;
+        end = 0;
+        exhausted = false;
+    }
+
+    void InputChannel::RedirectTo(int target) {
+        Reset();
+        fd = target;
+        source = nullptr;
+    }
+
+    void InputChannel::RedirectTo(Source target) {
+        Reset();
+        source = std::move(target);
+    }
+
+    bool InputChannel::Fill() {
+        if (exhausted)
+            return false;
+
+        // Keep the unread bytes and make room behind them, growing only when a
+        // single line does not fit in the buffer
+        if (start > 0) {
+            std::memmove(buffer.get(), buffer.get() + start, end - start);
+            end -= start;
+            start = 0;
+        }
+        if (end == capacity) {
+            auto grown = std::make_unique<char[]>(capacity * 2);
+            std::memcpy(grown.get(), buffer.get(), end);
+            buffer = std::move(grown);
+            capacity *= 2;
+        }
+
+        size_t got;
+        if (source) {
+            got = source(buffer.get() + end, capacity - end);
+        } else {
+            for (;;) {
+#if defined(_WIN32)
+                int n = ::_read(fd, buffer.get() + end, static_cast<unsigned int>(capacity - end));
+#else
+                ssize_t n = ::read(fd, buffer.get() + end, capacity - end);
+#endif
+                if (n < 0 && errno == EINTR) continue;
+                got = n > 0 ? static_cast<size_t>(n) : 0;
+                break;
+            }
+        }
+
+        if (got == 0) {
+            exhausted = true;
+            return false;
+        }
+        end += got;
+        return true;
+    }
+
+    std::string_view InputChannel::ReadLine() {
+        size_t scanned = start;
+        for (;;) {
+            const char* base = buffer.get();
+            auto* newline = static_cast<const char*>(std::memchr(base + scanned, '\n', end - scanned));
+            if (newline) {
+                std::string_view line(base + start, newline - (base + start));
+                start = newline - base + 1;
+                return line;
+            }
+
+            // Fill() moves the unread bytes to the front of the buffer
+            scanned = end - start;
+            if (!Fill()) {
+                std::string_view rest(buffer.get() + start, end - start);
+                start = end;
+                return rest;
+            }
+        }
+    }
+}
@@ -0,0 +1,721 @@
+#include <DotNyet/VM/Jit.hpp>
+#include <DotNyet/Bytecode/Opcodes.hpp>
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <map>
+#include <utility>
+
+#if DOTNYET_JIT
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace DotNyet::VM {
+
+#if DOTNYET_JIT
+    namespace {
+        using Bytecode::Opcode;
+        using Types::ValueType;
+
+        enum Reg : int {
+            RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+            R8 = 8, R9 = 9, R10 = 10, R11 = 11, R12 = 12, R13 = 13, R14 = 14, R15 = 15,
+        };
+
+        // Condition codes as encoded in Jcc/SETcc
+        enum Cond : uint8_t {
+            CondE = 0x4,
+            CondNE = 0x5,
+            CondNP = 0xB,
+        };
+
+        // Registers compiled code keeps its state in. All of them are
+        // callee-saved, so they survive calls into the runtime.
+        constexpr Reg StateReg = RBX;
+        constexpr Reg TopReg = R12;
+        constexpr Reg FrameReg = R13;
+        constexpr Reg CountReg = R15;
+
+        // A Value is a one byte tag followed by an 8-byte payload (see Types::Value)
+        constexpr int32_t TagOffset = 0;
+        constexpr int32_t PayloadOffset = 8;
+        constexpr int32_t ValueSize = sizeof(Types::Value);
+
+        constexpr uint8_t Tag(ValueType type) {
+            return static_cast<uint8_t>(type);
+        }
+
+        // Just enough of an x86-64 encoder for the templates below. Every memory
+        // operand is [base + disp32].
+        class Assembler {
+        public:
+            std::vector<uint8_t> bytes;
+
+            size_t Position() const {
+                return bytes.size();
+            }
+
+            void Byte(uint8_t b) {
+                bytes.push_back(b);
+            }
+
+            void U32(uint32_t v) {
+                for (int i = 0; i < 4; i++)
+                    Byte(static_cast<uint8_t>(v >> (8 * i)));
+            }
+
+            void U64(uint64_t v) {
+                for (int i = 0; i < 8; i++)
+                    Byte(static_cast<uint8_t>(v >> (8 * i)));
+            }
+
+            // Makes the rel32 field at `at` point to `target`
+            void Patch(size_t at, size_t target) {
+                auto rel = static_cast<uint32_t>(static_cast<int32_t>(target) - static_cast<int32_t>(at + 4));
+                for (int i = 0; i < 4; i++)
+                    bytes[at + i] = static_cast<uint8_t>(rel >> (8 * i));
+            }
+
+            void Push(Reg r) { Rex(false, 0, r); Byte(0x50 + (r & 7)); }
+            void Pop(Reg r) { Rex(false, 0, r); Byte(0x58 + (r & 7)); }
+            void Ret() { Byte(0xC3); }
+
+            // mov r64, [base + disp]
+            void Load(Reg r, Reg base, int32_t disp) { Rex(true, r, base); Byte(0x8B); Mem(r, base, disp); }
+            // mov [base + disp], r64
+            void Store(Reg base, int32_t disp, Reg r) { Rex(true, r, base); Byte(0x89); Mem(r, base, disp); }
+            // movzx r32, byte [base + disp]
+            void LoadByte(Reg r, Reg base, int32_t disp) { Rex(false, r, base); Byte(0x0F); Byte(0xB6); Mem(r, base, disp); }
+            // mov byte [base + disp], imm8
+            void StoreByte(Reg base, int32_t disp, uint8_t imm) { Rex(false, 0, base); Byte(0xC6); Mem(0, base, disp); Byte(imm); }
+            // mov qword [base + disp], simm32
+            void StoreImm(Reg base, int32_t disp, int32_t imm) { Rex(true, 0, base); Byte(0xC7); Mem(0, base, disp); U32(imm); }
+            // cmp byte [base + disp], imm8
+            void CmpByte(Reg base, int32_t disp, uint8_t imm) { Rex(false, 0, base); Byte(0x80); Mem(7, base, disp); Byte(imm); }
+            // inc dword [base + disp]
+            void IncDword(Reg base, int32_t disp) { Rex(false, 0, base); Byte(0xFF); Mem(0, base, disp); }
+            // test dword [base + disp], imm32
+            void TestDwordImm(Reg base, int32_t disp, uint32_t imm) { Rex(false, 0, base); Byte(0xF7); Mem(0, base, disp); U32(imm); }
+            // add qword [base + disp], r64
+            void AddToMem(Reg base, int32_t disp, Reg r) { Rex(true, r, base); Byte(0x01); Mem(r, base, disp); }
+            // add qword [base + disp], simm32
+            void AddImmToMem(Reg base, int32_t disp, int32_t imm) { Rex(true, 0, base); Byte(0x81); Mem(0, base, disp); U32(imm); }
+            // cmp qword [base + disp], simm32
+            void CmpMemImm(Reg base, int32_t disp, int32_t imm) { Rex(true, 0, base); Byte(0x81); Mem(7, base, disp); U32(imm); }
+            // sub r64, [base + disp]
+            void Sub(Reg r, Reg base, int32_t disp) { Rex(true, r, base); Byte(0x2B); Mem(r, base, disp); }
+            // imul r64, [base + disp]
+            void Imul(Reg r, Reg base, int32_t disp) { Rex(true, r, base); Byte(0x0F); Byte(0xAF); Mem(r, base, disp); }
+            // cmp r64, [base + disp]
+            void Cmp(Reg r, Reg base, int32_t disp) { Rex(true, r, base); Byte(0x3B); Mem(r, base, disp); }
+            // lea r64, [base + disp]; unlike add/sub it leaves the flags alone
+            void Lea(Reg r, Reg base, int32_t disp) { Rex(true, r, base); Byte(0x8D); Mem(r, base, disp); }
+            // add r64, simm32 / sub r64, simm32
+            void AddImm(Reg r, int32_t imm) { Rex(true, 0, r); Byte(0x81); Direct(0, r); U32(imm); }
+            void SubImm(Reg r, int32_t imm) { Rex(true, 0, r); Byte(0x81); Direct(5, r); U32(imm); }
+            // cmp r32, simm32
+            void CmpImm32(Reg r, int32_t imm) { Rex(false, 0, r); Byte(0x81); Direct(7, r); U32(imm); }
+            // cmp al, imm8
+            void CmpAl(uint8_t imm) { Byte(0x3C); Byte(imm); }
+            // mov r64, r64
+            void Mov(Reg dst, Reg src) { Rex(true, src, dst); Byte(0x89); Direct(src, dst); }
+            // mov r64, imm64
+            void MovImm(Reg r, uint64_t imm) { Rex(true, 0, r); Byte(0xB8 + (r & 7)); U64(imm); }
+            // mov eax, imm32
+            void MovEax(uint32_t imm) { Byte(0xB8); U32(imm); }
+            // test r64, r64
+            void Test(Reg a, Reg b) { Rex(true, b, a); Byte(0x85); Direct(b, a); }
+            // setcc r8, for the low registers only
+            void Set(Cond cc, Reg r) { Byte(0x0F); Byte(0x90 + cc); Direct(0, r); }
+            // and r8, r8, for the low registers only
+            void AndByte(Reg dst, Reg src) { Byte(0x20); Direct(src, dst); }
+            // movzx r32, r8, for the low registers only
+            void ZeroExtendByte(Reg dst, Reg src) { Byte(0x0F); Byte(0xB6); Direct(dst, src); }
+
+            // SSE2 scalar double operations on xmm registers 0-7
+            void MovsdLoad(int xmm, Reg base, int32_t disp) { Byte(0xF2); Rex(false, xmm, base); Byte(0x0F); Byte(0x10); Mem(xmm, base, disp); }
+            void MovsdStore(Reg base, int32_t disp, int xmm) { Byte(0xF2); Rex(false, xmm, base); Byte(0x0F); Byte(0x11); Mem(xmm, base, disp); }
+            void AddsdMem(int xmm, Reg base, int32_t disp) { Byte(0xF2); Rex(false, xmm, base); Byte(0x0F); Byte(0x58); Mem(xmm, base, disp); }
+            void MulsdMem(int xmm, Reg base, int32_t disp) { Byte(0xF2); Rex(false, xmm, base); Byte(0x0F); Byte(0x59); Mem(xmm, base, disp); }
+            void UcomisdMem(int xmm, Reg base, int32_t disp) { Byte(0x66); Rex(false, xmm, base); Byte(0x0F); Byte(0x2E); Mem(xmm, base, disp); }
+            void Addsd(int dst, int src) { Byte(0xF2); Byte(0x0F); Byte(0x58); Direct(dst, src); }
+            // movq xmm, r64
+            void MovqToXmm(int xmm, Reg r) { Byte(0x66); Rex(true, xmm, r); Byte(0x0F); Byte(0x6E); Direct(xmm, r); }
+
+            void CallReg(Reg r) { Rex(false, 0, r); Byte(0xFF); Direct(2, r); }
+            void JmpReg(Reg r) { Rex(false, 0, r); Byte(0xFF); Direct(4, r); }
+
+            // Jumps with a rel32 field to be patched later; return its position
+            size_t Jmp() { Byte(0xE9); U32(0); return Position() - 4; }
+            size_t Jcc(Cond cc) { Byte(0x0F); Byte(0x80 + cc); U32(0); return Position() - 4; }
+
+        private:
+            void Rex(bool wide, int reg, int rm) {
+                uint8_t rex = 0x40 | (wide ? 0x08 : 0) | ((reg & 8) ? 0x04 : 0) | ((rm & 8) ? 0x01 : 0);
+                if (rex != 0x40)
+                    Byte(rex);
+            }
+
+            void Mem(int reg, int base, int32_t disp) {
+                Byte(static_cast<uint8_t>(0x80 | ((reg & 7) << 3) | (base & 7)));
+                // rsp and r12 as a base need a SIB byte
+                if ((base & 7) == RSP)
+                    Byte(0x24);
+                U32(static_cast<uint32_t>(disp));
+            }
+
+            void Direct(int reg, int rm) {
+                Byte(static_cast<uint8_t>(0xC0 | ((reg & 7) << 3) | (rm & 7)));
+            }
+        };
+
+        // Drops one reference to a string that compiled code overwrote or popped
+        void ReleaseString(Types::StringObject* str) noexcept {
+            str->Release();
+        }
+
+        bool FitsImm32(int64_t value) {
+            return value >= INT32_MIN && value <= INT32_MAX;
+        }
+
+        // Instructions a superinstruction stands for
+        uint32_t Length(Opcode op) {
+            switch (op) {
+            case Opcode::ADD_LOCAL_CONST:
+            case Opcode::CMP_JNZ_LOCALS:
+            case Opcode::CMP_JNZ_LOCAL_CONST:
+                return 4;
+            case Opcode::LOAD_CONST_STORE:
+            case Opcode::INPUT_INT:
+                return 2;
+            default:
+                return 1;
+            }
+        }
+
+        bool IsBranch(Opcode op) {
+            return op == Opcode::JMP || op == Opcode::JZ || op == Opcode::JNZ ||
+                   op == Opcode::CMP_JNZ_LOCALS || op == Opcode::CMP_JNZ_LOCAL_CONST;
+        }
+
+        // Instructions that always hand control back to the interpreter
+        bool IsInterpreted(Opcode op) {
+            switch (op) {
+            case Opcode::NOP:
+            case Opcode::PUSH:
+            case Opcode::POP:
+            case Opcode::CMP:
+            case Opcode::STORE:
+            case Opcode::LOAD:
+            case Opcode::JMP:
+            case Opcode::JZ:
+            case Opcode::JNZ:
+            case Opcode::ADD:
+            case Opcode::SUB:
+            case Opcode::MUL:
+            case Opcode::ADD_LOCAL_CONST:
+            case Opcode::CMP_JNZ_LOCALS:
+            case Opcode::CMP_JNZ_LOCAL_CONST:
+            case Opcode::LOAD_CONST_STORE:
+                return false;
+            default:
+                return true;
+            }
+        }
+
+        // Translates the instructions [start, end) of a verified program
+        class Compiler {
+        public:
+            Compiler(const Bytecode::Program& program, uint32_t start, uint32_t end)
+                : code(program.code), constants(program.constants), start(start), end(end),
+                  unit(end - start, false), leader(end - start, false), remaining(end - start, 0),
+                  labels(end - start, 0) {}
+
+            Assembler assembler;
+            // Offsets of the entry points, for each instruction that has one
+            std::vector<std::pair<uint32_t, size_t>> entries;
+            size_t maxGrowth = 0;
+
+            void Compile() {
+                FindBlocks();
+
+                auto& a = assembler;
+                // uint32_t (State* state, const void* entry)
+                a.Push(RBX);
+                a.Push(R12);
+                a.Push(R13);
+                a.Push(R14);
+                a.Push(R15); // five pushes keep rsp 16-byte aligned for calls
+                a.Mov(StateReg, RDI);
+                a.Load(TopReg, StateReg, offsetof(Jit::State, top));
+                a.Load(FrameReg, StateReg, offsetof(Jit::State, frame));
+                a.Load(CountReg, StateReg, offsetof(Jit::State, executed));
+                a.JmpReg(RSI);
+
+                // Every exit lands here with the instruction to resume at in eax
+                epilogue = a.Position();
+                a.Store(StateReg, offsetof(Jit::State, top), TopReg);
+                a.Store(StateReg, offsetof(Jit::State, executed), CountReg);
+                a.Pop(R15);
+                a.Pop(R14);
+                a.Pop(R13);
+                a.Pop(R12);
+                a.Pop(RBX);
+                a.Ret();
+
+                bool fallsThrough = false;
+                for (uint32_t i = start; i < end; i++) {
+                    if (!unit[i - start])
+                        continue;
+                    if (leader[i - start]) {
+                        labels[i - start] = a.Position();
+                        entries.emplace_back(i, a.Position());
+                        a.AddImm(CountReg, static_cast<int32_t>(remaining[i - start]));
+                    }
+                    fallsThrough = Emit(i);
+                }
+                if (fallsThrough)
+                    AddExit(end, 0, a.Jmp());
+
+                for (const auto& [at, target] : jumps)
+                    a.Patch(at, labels[target - start]);
+
+                // Out-of-line exit stubs, one per distinct exit
+                std::map<std::pair<uint32_t, uint32_t>, size_t> stubs;
+                for (const auto& exit : exits) {
+                    auto key = std::make_pair(exit.ip, exit.uncounted);
+                    auto it = stubs.find(key);
+                    if (it == stubs.end()) {
+                        it = stubs.emplace(key, a.Position()).first;
+                        if (exit.uncounted)
+                            a.SubImm(CountReg, static_cast<int32_t>(exit.uncounted));
+                        a.MovEax(exit.ip);
+                        a.Patch(a.Jmp(), epilogue);
+                    }
+                    a.Patch(exit.at, it->second);
+                }
+            }
+
+        private:
+            struct Exit {
+                uint32_t ip;
+                uint32_t uncounted; // instructions counted ahead that did not run
+                size_t at;
+            };
+
+            const std::vector<Bytecode::Instruction>& code;
+            const std::vector<Types::Value>& constants;
+            uint32_t start;
+            uint32_t end;
+            std::vector<bool> unit;           // starts an instruction or superinstruction
+            std::vector<bool> leader;         // starts a basic block
+            std::vector<uint32_t> remaining;  // units from here to the end of the block
+            std::vector<size_t> labels;
+            std::vector<std::pair<size_t, uint32_t>> jumps;
+            std::vector<Exit> exits;
+            size_t epilogue = 0;
+
+            bool InRange(uint32_t ip) const {
+                return ip >= start && ip < end && unit[ip - start];
+            }
+
+            static uint32_t Target(const Bytecode::Instruction* ins) {
+                return ins->op == Opcode::CMP_JNZ_LOCALS || ins->op == Opcode::CMP_JNZ_LOCAL_CONST ? ins[3].operand : ins->operand;
+            }
+
+            void FindBlocks() {
+                if (start == end)
+                    return;
+                leader[0] = true;
+                for (uint32_t i = start; i < end; i += Length(code[i].op)) {
+                    unit[i - start] = true;
+                    Opcode op = Bytecode::Generic(code[i].op);
+                    if (op == Opcode::PUSH || op == Opcode::LOAD)
+                        maxGrowth++;
+                }
+
+                for (uint32_t i = start; i < end; i += Length(code[i].op)) {
+                    Opcode op = Bytecode::Generic(code[i].op);
+                    uint32_t next = i + Length(op);
+                    if (IsBranch(op)) {
+                        uint32_t target = Target(&code[i]);
+                        if (InRange(target))
+                            leader[target - start] = true;
+                    }
+                    if ((IsBranch(op) || IsInterpreted(op)) && next < end)
+                        leader[next - start] = true;
+                }
+
+                uint32_t count = 0;
+                for (uint32_t i = end; i-- > start;) {
+                    if (!unit[i - start])
+                        continue;
+                    count++;
+                    remaining[i - start] = count;
+                    if (leader[i - start])
+                        count = 0;
+                }
+            }
+
+            // Leaves compiled code at instruction `ip` through the jump at `at`
+            void AddExit(uint32_t ip, uint32_t uncounted, size_t at) {
+                exits.push_back(Exit{ip, uncounted, at});
+            }
+
+            // Exit taken when the type guard at instruction `ip` fails
+            void Guard(uint32_t ip, size_t at) {
+                AddExit(ip, remaining[ip - start], at);
+            }
+
+            // Continues at bytecode `target`, in compiled code if possible
+            void Branch(size_t at, uint32_t target) {
+                if (InRange(target))
+                    jumps.emplace_back(at, target);
+                else
+                    AddExit(target, 0, at);
+            }
+
+            void ReleaseIfString(Reg base, int32_t disp) {
+                auto& a = assembler;
+                a.CmpByte(base, disp + TagOffset, Tag(ValueType::String));
+                size_t skip = a.Jcc(CondNE);
+                a.Load(RDI, base, disp + PayloadOffset);
+                a.MovImm(RAX, reinterpret_cast<uint64_t>(&ReleaseString));
+                a.CallReg(RAX);
+                a.Patch(skip, a.Position());
+            }
+
+            // Writes a copy of `value` into the (dead) slot at [base + disp]
+            void WriteConstant(Reg base, int32_t disp, const Types::Value& value) {
+                auto& a = assembler;
+                a.StoreByte(base, disp + TagOffset, Tag(value.Type()));
+                switch (value.Type()) {
+                case ValueType::Integer:
+                    if (FitsImm32(value.AsInt())) {
+                        a.StoreImm(base, disp + PayloadOffset, static_cast<int32_t>(value.AsInt()));
+                    } else {
+                        a.MovImm(RAX, static_cast<uint64_t>(value.AsInt()));
+                        a.Store(base, disp + PayloadOffset, RAX);
+                    }
+                    break;
+                case ValueType::Double:
+                    a.MovImm(RAX, std::bit_cast<uint64_t>(value.AsDouble()));
+                    a.Store(base, disp + PayloadOffset, RAX);
+                    break;
+                case ValueType::Boolean:
+                    a.StoreImm(base, disp + PayloadOffset, value.AsBool() ? 1 : 0);
+                    break;
+                case ValueType::String:
+                    a.MovImm(RAX, reinterpret_cast<uint64_t>(value.AsStringObject()));
+                    if (!value.AsStringObject()->IsFrozen())
+                        a.IncDword(RAX, 0); // the StringObject reference count
+                    a.Store(base, disp + PayloadOffset, RAX);
+                    break;
+                default:
+                    a.StoreImm(base, disp + PayloadOffset, 0);
+                    break;
+                }
+            }
+
+            // Requires both operands on top of the stack to have tag `tag`;
+            // returns the jump taken if the topmost one does not
+            size_t GuardOperands(uint32_t ip, ValueType type) {
+                auto& a = assembler;
+                a.CmpByte(TopReg, -ValueSize + TagOffset, Tag(type));
+                size_t mismatch = a.Jcc(CondNE);
+                a.CmpByte(TopReg, -2 * ValueSize + TagOffset, Tag(type));
+                Guard(ip, a.Jcc(CondNE));
+                return mismatch;
+            }
+
+            // Emits instruction `i`; returns whether control can fall through
+            bool Emit(uint32_t i) {
+                auto& a = assembler;
+                const Bytecode::Instruction* ins = &code[i];
+                // Payloads of the two topmost operands
+                constexpr int32_t top0 = -ValueSize + PayloadOffset;
+                constexpr int32_t top1 = -2 * ValueSize + PayloadOffset;
+                auto slot = [](uint32_t address) { return static_cast<int32_t>(address) * ValueSize; };
+                // The interpreter may have quickened the instruction already
+                const Opcode op = Bytecode::Generic(ins->op);
+
+                switch (op) {
+                case Opcode::NOP:
+                    return true;
+
+                case Opcode::PUSH:
+                    WriteConstant(TopReg, 0, constants[ins->operand]);
+                    a.AddImm(TopReg, ValueSize);
+                    return true;
+
+                case Opcode::POP:
+                    a.SubImm(TopReg, ValueSize);
+                    ReleaseIfString(TopReg, 0);
+                    return true;
+
+                case Opcode::LOAD: {
+                    int32_t at = slot(ins->operand);
+                    a.Load(RAX, FrameReg, at + TagOffset);
+                    a.Load(RCX, FrameReg, at + PayloadOffset);
+                    a.CmpAl(Tag(ValueType::String));
+                    size_t skip = a.Jcc(CondNE);
+                    // Like StringObject::Retain, leave frozen (shared) strings alone
+                    a.TestDwordImm(RCX, 0, Types::StringObject::FrozenBit);
+                    size_t frozen = a.Jcc(CondNE);
+                    a.IncDword(RCX, 0);
+                    a.Patch(skip, a.Position());
+                    a.Patch(frozen, a.Position());
+                    a.Store(TopReg, TagOffset, RAX);
+                    a.Store(TopReg, PayloadOffset, RCX);
+                    a.AddImm(TopReg, ValueSize);
+                    return true;
+                }
+
+                case Opcode::STORE: {
+                    int32_t at = slot(ins->operand);
+                    a.SubImm(TopReg, ValueSize);
+                    ReleaseIfString(FrameReg, at);
+                    a.Load(RAX, TopReg, TagOffset);
+                    a.Store(FrameReg, at + TagOffset, RAX);
+                    a.Load(RAX, TopReg, PayloadOffset);
+                    a.Store(FrameReg, at + PayloadOffset, RAX);
+                    return true;
+                }
+
+                case Opcode::ADD:
+                case Opcode::MUL: {
+                    size_t notInt = GuardOperands(i, ValueType::Integer);
+                    if (op == Opcode::ADD) {
+                        a.Load(RAX, TopReg, top0);
+                        a.AddToMem(TopReg, top1, RAX);
+                    } else {
+                        a.Load(RAX, TopReg, top1);
+                        a.Imul(RAX, TopReg, top0);
+                        a.Store(TopReg, top1, RAX);
+                    }
+                    a.SubImm(TopReg, ValueSize);
+                    size_t done = a.Jmp();
+
+                    a.Patch(notInt, a.Position());
+                    Guard(i, GuardOperands(i, ValueType::Double));
+                    a.MovsdLoad(0, TopReg, top1);
+                    if (op == Opcode::ADD)
+                        a.AddsdMem(0, TopReg, top0);
+                    else
+                        a.MulsdMem(0, TopReg, top0);
+                    a.MovsdStore(TopReg, top1, 0);
+                    a.SubImm(TopReg, ValueSize);
+                    a.Patch(done, a.Position());
+                    return true;
+                }
+
+                case Opcode::SUB: {
+                    // Top(0) - Top(1), as the interpreter computes it
+                    Guard(i, GuardOperands(i, ValueType::Integer));
+                    a.Load(RAX, TopReg, top0);
+                    a.Sub(RAX, TopReg, top1);
+                    a.Store(TopReg, top1, RAX);
+                    a.SubImm(TopReg, ValueSize);
+                    return true;
+                }
+
+                case Opcode::CMP: {
+                    size_t notInt = GuardOperands(i, ValueType::Integer);
+                    a.Load(RAX, TopReg, top1);
+                    a.Cmp(RAX, TopReg, top0);
+                    a.Set(CondE, RAX);
+                    size_t store = a.Jmp();
+
+                    a.Patch(notInt, a.Position());
+                    Guard(i, GuardOperands(i, ValueType::Double));
+                    a.MovsdLoad(0, TopReg, top1);
+                    a.UcomisdMem(0, TopReg, top0);
+                    // Unordered (NaN) compares unequal
+                    a.Set(CondE, RAX);
+                    a.Set(CondNP, RCX);
+                    a.AndByte(RAX, RCX);
+
+                    a.Patch(store, a.Position());
+                    a.ZeroExtendByte(RAX, RAX);
+                    a.Store(TopReg, top1, RAX);
+                    a.StoreByte(TopReg, -2 * ValueSize + TagOffset, Tag(ValueType::Boolean));
+                    a.SubImm(TopReg, ValueSize);
+                    return true;
+                }
+
+                case Opcode::JZ:
+                case Opcode::JNZ: {
+                    // Truthiness of booleans and ints; anything else is left to the interpreter
+                    a.LoadByte(RCX, TopReg, -ValueSize + TagOffset);
+                    a.CmpImm32(RCX, Tag(ValueType::Boolean));
+                    size_t notBool = a.Jcc(CondNE);
+                    a.LoadByte(RAX, TopReg, top0);
+                    size_t test = a.Jmp();
+                    a.Patch(notBool, a.Position());
+                    a.CmpImm32(RCX, Tag(ValueType::Integer));
+                    Guard(i, a.Jcc(CondNE));
+                    a.Load(RAX, TopReg, top0);
+                    a.Patch(test, a.Position());
+                    a.Lea(TopReg, TopReg, -ValueSize);
+                    a.Test(RAX, RAX);
+                    Branch(a.Jcc(op == Opcode::JZ ? CondE : CondNE), ins->operand);
+                    return true;
+                }
+
+                case Opcode::JMP:
+                    Branch(a.Jmp(), ins->operand);
+                    return false;
+
+                case Opcode::ADD_LOCAL_CONST: {
+                    int32_t at = slot(ins->operand);
+                    const Types::Value& constant = constants[ins[1].operand];
+                    if (constant.IsInt()) {
+                        a.CmpByte(FrameReg, at + TagOffset, Tag(ValueType::Integer));
+                        Guard(i, a.Jcc(CondNE));
+                        if (FitsImm32(constant.AsInt())) {
+                            a.AddImmToMem(FrameReg, at + PayloadOffset, static_cast<int32_t>(constant.AsInt()));
+                        } else {
+                            a.MovImm(RAX, static_cast<uint64_t>(constant.AsInt()));
+                            a.AddToMem(FrameReg, at + PayloadOffset, RAX);
+                        }
+                    } else if (constant.IsDouble()) {
+                        a.CmpByte(FrameReg, at + TagOffset, Tag(ValueType::Double));
+                        Guard(i, a.Jcc(CondNE));
+                        a.MovImm(RAX, std::bit_cast<uint64_t>(constant.AsDouble()));
+                        a.MovqToXmm(1, RAX);
+                        a.MovsdLoad(0, FrameReg, at + PayloadOffset);
+                        a.Addsd(0, 1);
+                        a.MovsdStore(FrameReg, at + PayloadOffset, 0);
+                    } else {
+                        Guard(i, a.Jmp());
+                        return false;
+                    }
+                    return true;
+                }
+
+                case Opcode::CMP_JNZ_LOCALS: {
+                    int32_t lhs = slot(ins->operand);
+                    int32_t rhs = slot(ins[1].operand);
+                    a.CmpByte(FrameReg, lhs + TagOffset, Tag(ValueType::Integer));
+                    Guard(i, a.Jcc(CondNE));
+                    a.CmpByte(FrameReg, rhs + TagOffset, Tag(ValueType::Integer));
+                    Guard(i, a.Jcc(CondNE));
+                    a.Load(RAX, FrameReg, lhs + PayloadOffset);
+                    a.Cmp(RAX, FrameReg, rhs + PayloadOffset);
+                    Branch(a.Jcc(CondE), ins[3].operand);
+                    return true;
+                }
+
+                case Opcode::CMP_JNZ_LOCAL_CONST: {
+                    int32_t at = slot(ins->operand);
+                    const Types::Value& constant = constants[ins[1].operand];
+                    if (!constant.IsInt()) {
+                        Guard(i, a.Jmp());
+                        return false;
+                    }
+                    a.CmpByte(FrameReg, at + TagOffset, Tag(ValueType::Integer));
+                    Guard(i, a.Jcc(CondNE));
+                    if (FitsImm32(constant.AsInt())) {
+                        a.CmpMemImm(FrameReg, at + PayloadOffset, static_cast<int32_t>(constant.AsInt()));
+                    } else {
+                        a.MovImm(RCX, static_cast<uint64_t>(constant.AsInt()));
+                        a.Cmp(RCX, FrameReg, at + PayloadOffset);
+                    }
+                    Branch(a.Jcc(CondE), ins[3].operand);
+                    return true;
+                }
+
+                case Opcode::LOAD_CONST_STORE: {
+                    int32_t at = slot(ins[1].operand);
+                    ReleaseIfString(FrameReg, at);
+                    WriteConstant(FrameReg, at, constants[ins->operand]);
+                    return true;
+                }
+
+                default:
+                    // CALL, RET, I/O, DIV, TOINT, SUBSTR, HALT
+                    Guard(i, a.Jmp());
+                    return false;
+                }
+            }
+        };
+    }
+#endif
+
+    Jit::Code::Code(uint32_t start, uint32_t end)
+        : start(start), end(end), entries(end - start, nullptr) {}
+
+    Jit::Code::~Code() {
+#if DOTNYET_JIT
+        if (memory)
+            munmap(memory, mapped);
+#endif
+    }
+
+    Jit::Jit(const Bytecode::Program& program, uint32_t threshold)
+        : program(program), threshold(std::max<uint32_t>(threshold, 1)), functions(program.functions.size()),
+          logger("VM/Jit") {}
+
+    Jit::~Jit() = default;
+
+    bool Jit::IsAvailable() {
+#if DOTNYET_JIT
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    const Jit::Code* Jit::Compile(uint32_t index) {
+        auto& slot = functions[index];
+        slot.failed = true;
+#if DOTNYET_JIT
+        if (!program.verified)
+            return nullptr;
+
+        // A function runs up to the next DEF
+        const auto& function = program.functions[index];
+        uint32_t end = static_cast<uint32_t>(program.code.size());
+        for (const auto& other : program.functions) {
+            if (other.entry > function.entry)
+                end = std::min(end, other.entry - 1);
+        }
+
+        Compiler compiler(program, function.entry, end);
+        compiler.Compile();
+        const auto& bytes = compiler.assembler.bytes;
+
+        size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t size = (bytes.size() + page - 1) / page * page;
+        void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            logger.Warn("Cannot map memory for compiling '{}', leaving it to the interpreter", function.name);
+            return nullptr;
+        }
+        std::memcpy(memory, bytes.data(), bytes.size());
+        if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+            munmap(memory, size);
+            logger.Warn("Cannot make code for '{}' executable, leaving it to the interpreter", function.name);
+            return nullptr;
+        }
+
+        auto code = std::make_unique<Code>(function.entry, end);
+        code->memory = memory;
+        code->mapped = size;
+        code->maxGrowth = compiler.maxGrowth;
+        code->function = reinterpret_cast<Code::Function>(memory);
+        for (const auto& [ip, offset] : compiler.entries)
+            code->entries[ip - function.entry] = static_cast<const uint8_t*>(memory) + offset;
+
+        logger.Info("Compiled '{}' ({} instructions) to {} bytes of machine code", function.name, end - function.entry, bytes.size());
+        slot.failed = false;
+        slot.code = std::move(code);
+        compiled++;
+        return slot.code.get();
+#else
+        (void)index;
+        return nullptr;
+#endif
+    }
+}
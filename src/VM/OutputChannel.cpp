@@ -0,0 +1,90 @@
+#include <DotNyet/VM/OutputChannel.hpp>
+#include <cerrno>
+#include <charconv>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace DotNyet::VM {
+
+    OutputChannel::OutputChannel() : fd(1) {
+        buffer.reserve(DefaultThreshold);
+    }
+
+    OutputChannel::~OutputChannel() {
+        Flush();
+    }
+
+    void OutputChannel::RedirectTo(int target) {
+        Flush();
+        fd = target;
+        sink = nullptr;
+    }
+
+    void OutputChannel::RedirectTo(Sink target) {
+        Flush();
+        sink = std::move(target);
+    }
+
+    void OutputChannel::Write(const Types::Value& value) {
+        using Types::ValueType;
+
+        char digits[64];
+        switch (value.Type()) {
+            case ValueType::Null:
+                Write("null");
+                return;
+            case ValueType::Integer: {
+                auto result = std::to_chars(digits, digits + sizeof(digits), value.AsInt());
+                Write(std::string_view(digits, result.ptr - digits));
+                return;
+            }
+            case ValueType::Double: {
+                // Same digits as std::to_string, which prints with "%f"
+                auto result = std::to_chars(digits, digits + sizeof(digits), value.AsDouble(), std::chars_format::fixed, 6);
+                if (result.ec == std::errc())
+                    Write(std::string_view(digits, result.ptr - digits));
+                else
+                    Write(value.ToString());
+                return;
+            }
+            case ValueType::Boolean:
+                Write(value.AsBool() ? "true" : "false");
+                return;
+            case ValueType::String:
+                Write(value.AsString());
+                return;
+            default:
+                Write("<unknown>");
+                return;
+        }
+    }
+
+    void OutputChannel::Flush() {
+        if (buffer.empty()) return;
+
+        if (sink) {
+            sink(buffer);
+            buffer.clear();
+            return;
+        }
+
+        const char* data = buffer.data();
+        size_t remaining = buffer.size();
+        while (remaining > 0) {
+#if defined(_WIN32)
+            int written = ::_write(fd, data, static_cast<unsigned int>(remaining));
+#else
+            ssize_t written = ::write(fd, data, remaining);
+#endif
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0) break;
+            data += written;
+            remaining -= static_cast<size_t>(written);
+        }
+        buffer.clear();
+    }
+}
@@ -0,0 +1,240 @@
+#include <DotNyet/VM/Profiler.hpp>
+#include <algorithm>
+#include <chrono>
+#include <fmt/core.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <x86intrin.h>
+#define DOTNYET_PROFILER_TSC 1
+#endif
+
+namespace DotNyet::VM {
+
+    namespace {
+        uint64_t Nanos() {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+        }
+
+        constexpr uint32_t NoFunction = UINT32_MAX;
+        constexpr size_t TopBackEdges = 10;
+
+        double Percent(uint64_t part, uint64_t whole) {
+            return whole ? 100.0 * static_cast<double>(part) / static_cast<double>(whole) : 0.0;
+        }
+    }
+
+    uint64_t Profiler::Ticks() {
+#if DOTNYET_PROFILER_TSC
+        return __rdtsc();
+#else
+        return Nanos();
+#endif
+    }
+
+    Profiler::Profiler(const Bytecode::Program& program)
+        : program(program), functions(program.functions.size()), backEdges(program.code.size()) {
+        // Node 0 stands for the empty stack
+        nodes.push_back(Node{NoFunction, 0});
+
+        // The smallest time two back-to-back reads can measure; taken off every sample
+        sampleOverhead = UINT64_MAX;
+        for (int i = 0; i < 64; i++) {
+            uint64_t before = Ticks();
+            sampleOverhead = std::min(sampleOverhead, Ticks() - before);
+        }
+
+        countdown = NextInterval();
+        startTicks = Ticks();
+        startNanos = Nanos();
+    }
+
+    // Random spacing keeps samples from lining up with loops of a fixed length
+    uint32_t Profiler::NextInterval() {
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+        return 32 + (random & 63);
+    }
+
+    void Profiler::Sample(Bytecode::Opcode op) {
+        uint64_t now = Ticks();
+        if (sampling) {
+            // `now` ends the instruction the previous call started timing
+            auto& stats = opcodes[static_cast<uint8_t>(sampledOp)];
+            uint64_t elapsed = now - sampleStart;
+            stats.sampledTicks += elapsed > sampleOverhead ? elapsed - sampleOverhead : 0;
+            stats.samples++;
+            sampling = false;
+            countdown = NextInterval();
+        } else {
+            sampling = true;
+            sampledOp = op;
+            countdown = 1;
+            sampleStart = Ticks();
+        }
+    }
+
+    void Profiler::Enter(uint32_t function) {
+        uint32_t parent = frames.empty() ? 0 : frames.back().node;
+        uint64_t key = static_cast<uint64_t>(parent) << 32 | function;
+        auto [it, inserted] = children.try_emplace(key, static_cast<uint32_t>(nodes.size()));
+        if (inserted)
+            nodes.push_back(Node{function, parent});
+
+        auto& stats = functions[function];
+        stats.calls++;
+        stats.active++;
+        frames.push_back(Frame{function, it->second, Ticks()});
+    }
+
+    void Profiler::Leave() {
+        if (frames.empty())
+            return;
+
+        uint64_t now = Ticks();
+        const Frame& frame = frames.back();
+        uint64_t elapsed = now - frame.start;
+        uint64_t self = elapsed - std::min(elapsed, frame.children);
+
+        auto& stats = functions[frame.function];
+        stats.exclusive += self;
+        // Recursive activations are already covered by the outermost one
+        if (--stats.active == 0)
+            stats.inclusive += elapsed;
+        nodes[frame.node].exclusive += self;
+
+        frames.pop_back();
+        if (!frames.empty())
+            frames.back().children += elapsed;
+    }
+
+    void Profiler::Finish() {
+        while (!frames.empty())
+            Leave();
+        sampling = false;
+        endTicks = Ticks();
+        endNanos = Nanos();
+    }
+
+    double Profiler::NanosPerTick() const {
+        uint64_t ticks = (endTicks ? endTicks : Ticks()) - startTicks;
+        uint64_t nanos = (endNanos ? endNanos : Nanos()) - startNanos;
+        return ticks ? static_cast<double>(nanos) / static_cast<double>(ticks) : 1.0;
+    }
+
+    std::string Profiler::FunctionAt(size_t ip) const {
+        const Bytecode::Function* owner = nullptr;
+        for (const auto& function : program.functions) {
+            if (function.entry <= ip && (!owner || function.entry > owner->entry))
+                owner = &function;
+        }
+        return owner ? owner->name : "?";
+    }
+
+    std::string Profiler::Summary() const {
+        double nsPerTick = NanosPerTick();
+        auto ms = [&](double ticks) { return ticks * nsPerTick / 1e6; };
+
+        uint64_t instructions = 0;
+        for (const auto& stats : opcodes)
+            instructions += stats.count;
+        uint64_t total = (endTicks ? endTicks : Ticks()) - startTicks;
+
+        std::string out;
+        out += fmt::format("Profile: {} instructions in {:.3f} ms\n\n", instructions, ms(static_cast<double>(total)));
+
+        // Opcodes by estimated time: average sampled cost times the exact count
+        struct Row {
+            const char* name;
+            uint64_t count;
+            double ticksPerOp;
+            bool sampled;
+        };
+        std::vector<Row> rows;
+        for (size_t op = 0; op < opcodes.size(); op++) {
+            const auto& stats = opcodes[op];
+            if (!stats.count)
+                continue;
+            double perOp = stats.samples ? static_cast<double>(stats.sampledTicks) / static_cast<double>(stats.samples) : 0.0;
+            rows.push_back(Row{Bytecode::Name(static_cast<Bytecode::Opcode>(op)), stats.count, perOp, stats.samples != 0});
+        }
+        std::sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) {
+            return a.ticksPerOp * static_cast<double>(a.count) > b.ticksPerOp * static_cast<double>(b.count) ||
+                   (a.ticksPerOp * static_cast<double>(a.count) == b.ticksPerOp * static_cast<double>(b.count) && a.count > b.count);
+        });
+
+        out += fmt::format("{:<22} {:>14} {:>7} {:>10} {:>12}\n", "opcode", "count", "%", "ns/op", "est. ms");
+        for (const auto& row : rows) {
+            if (row.sampled)
+                out += fmt::format("{:<22} {:>14} {:>6.2f}% {:>10.2f} {:>12.3f}\n", row.name, row.count,
+                    Percent(row.count, instructions), row.ticksPerOp * nsPerTick, ms(row.ticksPerOp * static_cast<double>(row.count)));
+            else
+                out += fmt::format("{:<22} {:>14} {:>6.2f}% {:>10} {:>12}\n", row.name, row.count,
+                    Percent(row.count, instructions), "-", "-");
+        }
+
+        // Functions by inclusive time
+        std::vector<uint32_t> order;
+        for (uint32_t f = 0; f < functions.size(); f++) {
+            if (functions[f].calls)
+                order.push_back(f);
+        }
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            return functions[a].inclusive > functions[b].inclusive;
+        });
+
+        out += fmt::format("\n{:<22} {:>14} {:>12} {:>7} {:>12} {:>7}\n", "function", "calls", "incl. ms", "%", "excl. ms", "%");
+        for (uint32_t f : order) {
+            const auto& stats = functions[f];
+            out += fmt::format("{:<22} {:>14} {:>12.3f} {:>6.2f}% {:>12.3f} {:>6.2f}%\n", program.functions[f].name, stats.calls,
+                ms(static_cast<double>(stats.inclusive)), Percent(stats.inclusive, total),
+                ms(static_cast<double>(stats.exclusive)), Percent(stats.exclusive, total));
+        }
+
+        // The loops that went around most often
+        std::vector<size_t> edges;
+        for (size_t ip = 0; ip < backEdges.size(); ip++) {
+            if (backEdges[ip].count)
+                edges.push_back(ip);
+        }
+        std::sort(edges.begin(), edges.end(), [&](size_t a, size_t b) {
+            return backEdges[a].count > backEdges[b].count;
+        });
+        if (edges.size() > TopBackEdges)
+            edges.resize(TopBackEdges);
+
+        if (!edges.empty()) {
+            out += fmt::format("\n{:<22} {:>14} {:>14}\n", "back-edge", "jump", "taken");
+            for (size_t ip : edges) {
+                out += fmt::format("{:<22} {:>14} {:>14}\n", FunctionAt(ip), fmt::format("{} -> {}", ip, backEdges[ip].target),
+                    backEdges[ip].count);
+            }
+        }
+        return out;
+    }
+
+    std::string Profiler::CollapsedStacks() const {
+        double nsPerTick = NanosPerTick();
+        std::string out;
+        std::vector<uint32_t> path;
+        for (uint32_t n = 1; n < nodes.size(); n++) {
+            auto nanos = static_cast<uint64_t>(static_cast<double>(nodes[n].exclusive) * nsPerTick);
+            if (!nanos)
+                continue;
+
+            path.clear();
+            for (uint32_t at = n; at != 0; at = nodes[at].parent)
+                path.push_back(nodes[at].function);
+
+            for (size_t k = path.size(); k-- > 0;) {
+                // ';' separates frames and ' ' the count, so neither may appear in a name
+                for (char c : program.functions[path[k]].name)
+                    out += c == ';' || c == ' ' ? '_' : c;
+                out += k ? ';' : ' ';
+            }
+            out += fmt::format("{}\n", nanos);
+        }
+        return out;
+    }
+}
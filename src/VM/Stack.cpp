@@ -1,36 +1,51 @@
 #include <DotNyet/VM/Stack.hpp>
 #include <DotNyet/Core/Exceptions.hpp>
+#include <algorithm>
 
 namespace DotNyet::VM {
 
+    // Enough for typical programs without ever growing
+    constexpr size_t InitialCapacity = 256;
+
     Stack::Stack()
         : logger("VM/Stack")
-    {}
+    {
+        Grow(InitialCapacity);
+    }
 
-    void Stack::Push(const Types::Value& val) {
-        stack.push_back(val);
+    Stack::~Stack() {
+        DropTop(Size());
+        ::operator delete(base);
     }
 
-    Types::Value Stack::Pop() {
-        if (stack.empty()) {
-            logger.Warn("Stack underflow on Pop");
-            throw Core::StackException("Pop called on empty stack");
+    void Stack::Grow(size_t count) {
+        size_t size = Size();
+        size_t capacity = static_cast<size_t>(limit - base);
+        size_t newCapacity = std::max(capacity * 2, size + count);
+
+        auto* values = static_cast<Types::Value*>(::operator new(newCapacity * sizeof(Types::Value)));
+        for (size_t i = 0; i < size; i++) {
+            new (values + i) Types::Value(std::move(base[i]));
+            base[i].~Value();
         }
-        Types::Value val = stack.back();
-        stack.pop_back();
-        return val;
+        ::operator delete(base);
+
+        base = values;
+        top = values + size;
+        limit = values + newCapacity;
+    }
+
+    void Stack::Underflow(const char* msg) const {
+        logger.Warn("Stack underflow: {}", msg);
+        throw Core::StackException(msg);
     }
 
     const Types::Value& Stack::Peek(size_t depth) const {
-        if (depth >= stack.size()) {
+        if (depth >= Size()) {
             logger.Warn("Stack access out of bounds at depth {}", depth);
             throw Core::StackException("Peek access out of bounds");
         }
-        const auto& val = stack[stack.size() - 1 - depth];
+        const auto& val = top[-1 - static_cast<ptrdiff_t>(depth)];
         return val;
     }
-
-    size_t Stack::Size() const {
-        return stack.size();
-    }
 }
@@ -1,470 +1,1118 @@
 #include <DotNyet/VM/VirtualMachine.hpp>
 #include <DotNyet/Core/Exceptions.hpp>
-#include <iostream>
-#include <cstring>
+#include <DotNyet/Bytecode/Decoder.hpp>
+#include <DotNyet/Bytecode/Verifier.hpp>
+#include <DotNyet/Bytecode/Fuser.hpp>
+#include <DotNyet/Bytecode/MappedFile.hpp>
+#include <DotNyet/Bytecode/Snapshot.hpp>
+#include <DotNyet/Bytecode/Assembler.hpp>
+#include <algorithm>
+#include <iterator>
 #include <fmt/core.h>
 
 namespace DotNyet::VM {
 
+    namespace {
+        using Bytecode::Opcode;
+        using Types::ValueType;
+
+        // The quickened form of ADD, SUB, MUL, DIV or CMP for the operands `a`
+        // and `b`, or `op` itself if there is none for their types
+        Opcode Specialize(Opcode op, const Types::Value& a, const Types::Value& b) {
+            if (a.Type() != b.Type())
+                return op;
+
+            switch (a.Type()) {
+            case ValueType::Integer:
+                switch (op) {
+                case Opcode::ADD: return Opcode::ADD_II;
+                case Opcode::SUB: return Opcode::SUB_II;
+                case Opcode::MUL: return Opcode::MUL_II;
+                case Opcode::DIV: return Opcode::DIV_II;
+                case Opcode::CMP: return Opcode::CMP_II;
+                default: return op;
+                }
+            case ValueType::Double:
+                switch (op) {
+                case Opcode::ADD: return Opcode::ADD_DD;
+                case Opcode::MUL: return Opcode::MUL_DD;
+                case Opcode::DIV: return Opcode::DIV_DD;
+                default: return op;
+                }
+            case ValueType::String:
+                switch (op) {
+                case Opcode::ADD: return Opcode::ADD_SS;
+                case Opcode::CMP: return Opcode::CMP_SS;
+                default: return op;
+                }
+            default:
+                return op;
+            }
+        }
+    }
+
     VirtualMachine::VirtualMachine()
-        : ip(0), logger("VM/Core") {}
+        : ip(0),
+#if DOTNYET_THREADED_DISPATCH
+          dispatchMode(DispatchMode::Threaded),
+#else
+          dispatchMode(DispatchMode::Switch),
+#endif
+          logger("VM/Core") {}
+
+    std::shared_ptr<const Bytecode::Program> VirtualMachine::Prepare(std::span<const uint8_t> bytecode,
+                                                                     std::shared_ptr<const void> owner,
+                                                                     uint8_t version, bool verify, bool optimize,
+                                                                     PrepareStats* stats) {
+        Bytecode::Program decoded = Bytecode::Decoder(bytecode, version).Decode();
+        decoded.storage = std::move(owner);
+        PrepareStats done;
+        if (verify) {
+            Bytecode::Verifier(decoded).Verify();
+            if (optimize) {
+                done.optimized = Bytecode::Optimizer(decoded).Optimize();
+                // Cheap next to decoding, and it catches a broken rewrite
+                // before the program runs unchecked
+                Bytecode::Verifier(decoded).Verify();
+            }
+        }
+        done.fused = Bytecode::Fuser(decoded).Fuse();
+        if (stats)
+            *stats = done;
+        return Share(std::move(decoded));
+    }
+
+    std::shared_ptr<const Bytecode::Program> VirtualMachine::PrepareImage(std::span<const uint8_t> file,
+                                                                          std::shared_ptr<const void> owner, bool verify,
+                                                                          bool optimize,
+                                                                          PrepareStats* stats) {
+        if (Bytecode::IsSnapshot(file)) {
+            if (stats)
+                *stats = PrepareStats();
+            return Share(Bytecode::ReadSnapshot(file, std::move(owner)).program);
+        }
 
-    void VirtualMachine::LoadBytecode(std::vector<uint8_t> code) {
-        bytecode = std::move(code);
+        Bytecode::Image image = Bytecode::ReadImage(file);
+        if (!image.hasHeader)
+            Util::Logger("VM/Core").Warn("Invalid bytecode file: missing NYET magic header, reading it as version 1 code");
+        return Prepare(image.bytecode, std::move(owner), image.version, verify, optimize, stats);
+    }
+
+    std::shared_ptr<const Bytecode::Program> VirtualMachine::Share(Bytecode::Program program) {
+        // Instances on other threads copy the constants onto their stacks;
+        // frozen, they do so without writing to the shared reference counts.
+        // The Decoder may hand one object to several constants, which is
+        // fine since freezing and thawing are idempotent.
+        for (const auto& constant : program.constants) {
+            if (auto* str = constant.AsStringObject())
+                str->Freeze();
+        }
+        return std::shared_ptr<const Bytecode::Program>(new Bytecode::Program(std::move(program)), [](Bytecode::Program* program) {
+            for (const auto& constant : program->constants) {
+                if (auto* str = constant.AsStringObject())
+                    str->Thaw();
+            }
+            delete program;
+        });
+    }
+
+    void VirtualMachine::Load(std::shared_ptr<const Bytecode::Program> prepared) {
+        // Compiled code refers to the constants of the old program
+        jit.reset();
+        profiler.reset();
+        // Values on the stack or in frames may refer to the old constants
+        stack.DropTop(stack.Size());
+        callStack.Clear();
+        program = std::move(prepared);
+        prepareStats = PrepareStats();
+        instructions = program->code;
+        quickenMisses.assign(instructions.size(), 0);
         ip = 0;
-        functionTable.clear();
-        LoadFunctionTable();
     }
 
-    int64_t VirtualMachine::ReadInt64(size_t pos) const {
-        if (pos + 8 > bytecode.size())
-            throw Core::RuntimeException("Unexpected end of bytecode reading int64");
-        int64_t val;
-        std::memcpy(&val, &bytecode[pos], sizeof(int64_t));
-        return val;
+    void VirtualMachine::LoadBytecode(std::span<const uint8_t> bytecode, std::shared_ptr<const void> owner, uint8_t version) {
+        Util::Logger::ScopedLevel level(logLevel);
+        PrepareStats stats;
+        Load(Prepare(bytecode, std::move(owner), version, verify, optimize, &stats));
+        prepareStats = stats;
     }
 
-    uint32_t VirtualMachine::ReadUInt32(size_t pos) const {
-        if (pos + 4 > bytecode.size())
-            throw Core::RuntimeException("Unexpected end of bytecode reading uint32");
-        uint32_t val;
-        std::memcpy(&val, &bytecode[pos], sizeof(uint32_t));
-        return val;
+    void VirtualMachine::LoadBytecode(std::vector<uint8_t> bytecode, uint8_t version) {
+        auto owner = std::make_shared<const std::vector<uint8_t>>(std::move(bytecode));
+        LoadBytecode(std::span<const uint8_t>(*owner), owner, version);
     }
 
-    std::string VirtualMachine::ReadString(size_t pos, size_t len) const {
-        if (pos + len > bytecode.size())
-            throw Core::RuntimeException("Unexpected end of bytecode reading string");
-        return std::string(bytecode.begin() + pos, bytecode.begin() + pos + len);
+    void VirtualMachine::LoadImage(std::span<const uint8_t> file, std::shared_ptr<const void> owner) {
+        Util::Logger::ScopedLevel level(logLevel);
+        if (Bytecode::IsSnapshot(file)) {
+            LoadSnapshot(file, std::move(owner));
+            return;
+        }
+        Bytecode::Image image = Bytecode::ReadImage(file);
+        if (!image.hasHeader)
+            logger.Warn("Invalid bytecode file: missing NYET magic header, reading it as version 1 code");
+        LoadBytecode(image.bytecode, std::move(owner), image.version);
     }
 
-    void VirtualMachine::LoadFunctionTable() {
-        using namespace DotNyet::Bytecode;
-        size_t pos = 0;
-
-        while (pos < bytecode.size()) {
-            Opcode op = static_cast<Opcode>(bytecode[pos]);
-
-            if (op == Opcode::DEF) {
-                pos++; // consume DEF opcode
-                if (pos + 4 > bytecode.size())
-                    throw Core::RuntimeException("Unexpected end of bytecode reading DEF name length");
-
-                uint32_t nameLen = ReadUInt32(pos);
-                pos += 4;
-
-                if (pos + nameLen > bytecode.size())
-                    throw Core::RuntimeException("Unexpected end of bytecode reading DEF name");
-
-                std::string name = ReadString(pos, nameLen);
-                pos += nameLen;
-
-                functionTable[name] = pos;
-
-                size_t scanPos = pos;
-                while (scanPos < bytecode.size()) {
-                    Opcode scanOp = static_cast<Opcode>(bytecode[scanPos]);
-                    if (scanOp == Opcode::DEF)
-                        break;
-                    scanPos++;
-
-                    switch (scanOp) {
-                        case Opcode::PUSH: {
-                            if (scanPos >= bytecode.size())
-                                throw Core::RuntimeException("Unexpected end of bytecode reading PUSH type tag");
-
-                            auto tag = static_cast<ValueTypeTag>(bytecode[scanPos++]);
-
-                            switch (tag) {
-                                case ValueTypeTag::Null:
-                                    break;
-                                case ValueTypeTag::Integer:
-                                case ValueTypeTag::Double:
-                                    scanPos += 8;
-                                    break;
-                                case ValueTypeTag::Boolean:
-                                    scanPos += 1;
-                                    break;
-                                case ValueTypeTag::String: {
-                                    if (scanPos + 4 > bytecode.size())
-                                        throw Core::RuntimeException("Unexpected end of bytecode reading PUSH string length");
-                                    uint32_t strLen = ReadUInt32(scanPos);
-                                    scanPos += 4 + strLen;
-                                    break;
-                                }
-                                default:
-                                    throw Core::RuntimeException(fmt::format("Unknown PUSH ValueTypeTag {}", static_cast<int>(tag)));
-                            }
-                            break;
-                        }
-
-                        case Opcode::STORE:
-                        case Opcode::LOAD: {
-                            scanPos += 4;
-                            break;
-                        }
-
-                        case Opcode::CALL: {
-                            if (scanPos + 4 > bytecode.size())
-                                throw Core::RuntimeException("Unexpected end of bytecode reading CALL name length");
-                            uint32_t callNameLen = ReadUInt32(scanPos);
-                            scanPos += 4 + callNameLen;
-                            break;
-                        }
-
-                        case Opcode::JMP:
-                        case Opcode::JZ:
-                        case Opcode::JNZ: {
-                            scanPos += 4;
-                            break;
-                        }
-
-                        case Opcode::HALT:
-                        case Opcode::NOP:
-                        case Opcode::POP:
-                        case Opcode::CMP:
-                        case Opcode::PRINT:
-                        case Opcode::INPUT:
-                        case Opcode::RET:
-                        case Opcode::ADD:
-                        case Opcode::SUB:
-                        case Opcode::MUL:
-                        case Opcode::DIV:
-                        case Opcode::TOINT:
-                        case Opcode::SUBSTR:
-                            break;
-
-                        default:
-                            throw Core::RuntimeException(fmt::format("Unknown opcode during function scan: 0x{:02X}", static_cast<uint8_t>(scanOp)));
-                    }
-                }
+    void VirtualMachine::LoadImage(std::vector<uint8_t> file) {
+        auto owner = std::make_shared<const std::vector<uint8_t>>(std::move(file));
+        LoadImage(std::span<const uint8_t>(*owner), owner);
+    }
 
-                pos = scanPos;
-            } else {
-                break;
-            }
+    void VirtualMachine::LoadSource(std::string_view source) {
+        LoadImage(Bytecode::Assembler(source).Assemble());
+    }
+
+    void VirtualMachine::LoadFile(const std::string& path) {
+        if (Bytecode::IsSourcePath(path)) {
+            LoadImage(Bytecode::AssembleFile(path));
+            return;
         }
+        auto file = std::make_shared<const Bytecode::MappedFile>(path);
+        LoadImage(file->Bytes(), file);
+    }
+
+    std::vector<uint8_t> VirtualMachine::SaveSnapshot() const {
+        if (!program)
+            throw Core::RuntimeException("No program loaded");
+        return Bytecode::WriteSnapshot(*program, instructions, stack.Values());
+    }
+
+    void VirtualMachine::LoadSnapshot(std::span<const uint8_t> file, std::shared_ptr<const void> owner) {
+        Util::Logger::ScopedLevel level(logLevel);
+        Bytecode::Snapshot snapshot = Bytecode::ReadSnapshot(file, std::move(owner));
+        Load(Share(std::move(snapshot.program)));
+        for (auto& value : snapshot.stack)
+            stack.Push(std::move(value));
+        logger.Info("Restored a snapshot of {} instructions and {} functions", instructions.size(), program->functions.size());
+    }
+
+    Types::Value VirtualMachine::Run(std::string_view arguments) {
+        stack.DropTop(stack.Size());
+        stack.Push(Types::Value(arguments));
+        Run();
+        if (!stack.Size())
+            return Types::Value();
+        Types::Value result = stack.Pop();
+        // It may be a constant of the program, or refer to memory it borrows from
+        if (result.IsString())
+            return Types::Value(result.AsString());
+        return result;
     }
 
     void VirtualMachine::Run() {
-        logger.Info("Starting execution with {} bytes of bytecode", bytecode.size());
+        Util::Logger::ScopedLevel level(logLevel);
+        if (!program)
+            throw Core::RuntimeException("No program loaded");
+        logger.Info("Starting execution with {} instructions", instructions.size());
 
         // Check for 'main' function
-        auto it = functionTable.find("main");
-        if (it == functionTable.end()) {
+        auto it = program->functionTable.find("main");
+        if (it == program->functionTable.end()) {
             throw Core::RuntimeException("No 'main' function defined");
         }
 
-        // Simulate CALL to 'main'
-        callStack.push_back(bytecode.size());
-        ip = it->second;
-
-        while (ip < bytecode.size()) {
-            using namespace DotNyet::Bytecode;
-            Opcode op = static_cast<Opcode>(bytecode[ip++]);
+        // Simulate CALL to 'main', dropping frames an earlier run left behind
+        // when it ended through HALT or an exception
+        callStack.Clear();
+        const auto& main = program->functions[it->second];
+
+        // The unchecked engine relies on main finding every value it may pop
+        bool checked = !program->verified || stack.Size() < main.arguments;
+        if (checked && program->verified)
+            logger.Info("'main' may pop {} values but only {} are on the stack, running checked", main.arguments, stack.Size());
+
+        // Compiled code performs no checks either, and is invisible to the profiler
+        profiler.reset();
+        if (profiling) {
+            if (jitEnabled)
+                logger.Warn("Profiling runs without the JIT");
+            profiler = std::make_unique<Profiler>(*program);
+        } else if (jitEnabled && !checked && !jit) {
+            jit = std::make_unique<Jit>(*program, jitThreshold);
+        }
 
-            logger.Debug("IP = {} | Executing opcode: 0x{:02X}", ip - 1, static_cast<uint8_t>(op));
+        PushFrame(main, instructions.size());
+        ip = main.entry;
 
-            try {
-                switch (op) {
-                    case Opcode::HALT:
-                        logger.Debug("HALT");
-                        return;
-
-                    case Opcode::NOP:
-                        logger.Debug("NOP");
-                        break;
-
-                    case Opcode::PUSH: {
-                        if (ip >= bytecode.size())
-                            throw Core::RuntimeException("Unexpected end of bytecode reading PUSH type tag");
-
-                        auto typeTag = static_cast<ValueTypeTag>(bytecode[ip++]);
-                        logger.Debug("PUSH type tag: {}", static_cast<int>(typeTag));
-
-                        switch (typeTag) {
-                            case ValueTypeTag::Null:
-                                logger.Debug("PUSH Null");
-                                stack.Push(Types::Value());
-                                break;
-
-                            case ValueTypeTag::Integer: {
-                                int64_t val = ReadInt64(ip);
-                                ip += 8;
-                                logger.Debug("PUSH Integer: {}", val);
-                                stack.Push(Types::Value(val));
-                                break;
-                            }
-
-                            case ValueTypeTag::Double: {
-                                if (ip + 8 > bytecode.size())
-                                    throw Core::RuntimeException("Unexpected end of bytecode reading double");
-                                double val;
-                                std::memcpy(&val, &bytecode[ip], sizeof(double));
-                                ip += 8;
-                                logger.Debug("PUSH Double: {}", val);
-                                stack.Push(Types::Value(val));
-                                break;
-                            }
-
-                            case ValueTypeTag::Boolean: {
-                                if (ip >= bytecode.size())
-                                    throw Core::RuntimeException("Unexpected end of bytecode reading bool");
-                                bool val = bytecode[ip++] != 0;
-                                logger.Debug("PUSH Boolean: {}", val);
-                                stack.Push(Types::Value(val));
-                                break;
-                            }
-
-                            case ValueTypeTag::String: {
-                                uint32_t len = ReadUInt32(ip); ip += 4;
-                                std::string str = ReadString(ip, len); ip += len;
-                                logger.Debug("PUSH String: \"{}\"", str);
-                                stack.Push(Types::Value(std::move(str)));
-                                break;
-                            }
-
-                            default:
-                                throw Core::RuntimeException(fmt::format("Unknown ValueTypeTag: {}", static_cast<int>(typeTag)));
-                        }
-                        break;
-                    }
-
-                    case Opcode::POP: {
-                        logger.Debug("POP");
-                        auto popped = stack.Pop();
-                        logger.Debug("Popped value: {}", popped.ToString());
-                        break;
-                    }
+        if (!profiler) {
+#if DOTNYET_THREADED_DISPATCH
+            if (dispatchMode == DispatchMode::Threaded) {
+                checked ? Execute<true, true, false>() : Execute<true, false, false>();
+                return;
+            }
+#endif
+            checked ? Execute<false, true, false>() : Execute<false, false, false>();
+            return;
+        }
 
-                    case Opcode::ADD: {
-                        logger.Debug("ADD");
-                        auto b = stack.Pop();
-                        auto a = stack.Pop();
-                        logger.Debug("Operands: a = {}, b = {}", a.ToString(), b.ToString());
-                        auto result = a + b;
-                        logger.Debug("Result: {}", result.ToString());
-                        stack.Push(result);
-                        break;
-                    }
+        profiler->Enter(it->second);
+        try {
+#if DOTNYET_THREADED_DISPATCH
+            if (dispatchMode == DispatchMode::Threaded)
+                checked ? Execute<true, true, true>() : Execute<true, false, true>();
+            else
+#endif
+                checked ? Execute<false, true, true>() : Execute<false, false, true>();
+        } catch (...) {
+            profiler->Finish();
+            throw;
+        }
+        profiler->Finish();
+    }
 
-                    case Opcode::SUB: {
-                        logger.Debug("SUB");
-                        auto a = stack.Pop();
-                        auto b = stack.Pop();
-                        logger.Debug("Operands: a = {}, b = {}", a.ToString(), b.ToString());
-                        auto result = a - b;
-                        logger.Debug("Result: {}", result.ToString());
-                        stack.Push(result);
-                        break;
-                    }
+    void VirtualMachine::PushFrame(const Bytecode::Function& function, size_t returnIp) {
+        if (callStack.Depth() >= maxCallDepth)
+            throw Core::StackOverflowException(fmt::format("Calling '{}' would exceed the maximum call depth of {}", function.name, maxCallDepth));
+        auto index = static_cast<uint32_t>(&function - program->functions.data());
+        callStack.Push(returnIp, index, function.localCount);
+    }
 
-                    case Opcode::MUL: {
-                        logger.Debug("MUL");
-                        auto a = stack.Pop();
-                        auto b = stack.Pop();
-                        logger.Debug("Operands: a = {}, b = {}", a.ToString(), b.ToString());
-                        auto result = a * b;
-                        logger.Debug("Result: {}", result.ToString());
-                        stack.Push(result);
-                        break;
-                    }
+    // Continues the innermost frame in `code` if it can be entered at `ip`
+    void VirtualMachine::RunCompiled(const Jit::Code* code, Types::Value* frame) {
+        if (!code)
+            return;
+        const void* entry = code->EntryAt(ip);
+        if (!entry)
+            return;
+
+        stack.Reserve(code->MaxGrowth());
+        Jit::State state{stack.End(), frame, 0};
+        ip = code->Run(state, entry);
+        stack.SetEnd(state.top);
+        executed += state.executed;
+    }
 
-                    case Opcode::DIV: {
-                        logger.Debug("DIV");
-                        auto a = stack.Pop();
-                        auto b = stack.Pop();
-                        logger.Debug("Operands: a = {}, b = {}", a.ToString(), b.ToString());
-                        auto result = a / b;
-                        logger.Debug("Result: {}", result.ToString());
-                        stack.Push(result);
-                        break;
-                    }
+    void VirtualMachine::Trace(size_t pos) const {
+        if (pos < instructions.size())
+            NYET_LOG_DEBUG(logger, "IP = {} | Executing opcode: 0x{:02X}", pos, static_cast<uint8_t>(instructions[pos].op));
+    }
 
-                    case Opcode::PRINT: {
-                        auto val = stack.Pop();
-                        std::cout << val.ToString();
-                        break;
-                    }
+// Both dispatch engines share the handler bodies below. VM_TARGET marks the entry
+// of a handler (a switch case, plus a label for the threaded engine) and
+// VM_DISPATCH transfers control to the handler of the instruction at `ip`.
+#if DOTNYET_THREADED_DISPATCH
+#define VM_LABEL(name) op_##name:
+#else
+#define VM_LABEL(name)
+#endif
+
+#define VM_TARGET(name) case Opcode::name: VM_LABEL(name)
+
+#if DOTNYET_THREADED_DISPATCH
+#define VM_DISPATCH()                                   \
+    do {                                                \
+        if constexpr (Threaded) {                       \
+            if (trace) Trace(ip);                       \
+            ins = code.data() + ip;                     \
+            ++count;                                    \
+            if constexpr (Profiled) {                   \
+                if (ip < end) profiler->Count(ins->op); \
+            }                                           \
+            goto *handlers[ip++];                       \
+        } else {                                        \
+            goto dispatch;                              \
+        }                                               \
+    } while (0)
+#else
+#define VM_DISPATCH() goto dispatch
+#endif
+
+// Continues at `target`, giving compiled code a chance on backward jumps
+#define VM_BRANCH(target)                                                               \
+    do {                                                                                \
+        uint32_t to = (target);                                                         \
+        bool backward = to < ip;                                                        \
+        ip = to;                                                                        \
+        if constexpr (Profiled) {                                                       \
+            if (backward) profiler->BackEdge(ins - code.data(), to);                    \
+        } else if constexpr (!Checked) {                                                \
+            if (backward && jit) RunCompiled(jit->Tick(callStack.Top().function), frame); \
+        }                                                                               \
+    } while (0)
+
+// A quickened instruction met operand types it does not handle: turn it back
+// into `generic` and run it again as that
+#define VM_DEOPTIMIZE(generic)                          \
+    do {                                                \
+        deoptimize(ip - 1, Opcode::generic);            \
+        --ip;                                           \
+        --count;                                        \
+        VM_DISPATCH();                                  \
+    } while (0)
+
+    template <bool Threaded, bool Checked, bool Profiled>
+    void VirtualMachine::Execute() {
+        using namespace DotNyet::Bytecode;
 
-                    case Opcode::DEF: {
-                        uint32_t nameLen = ReadUInt32(ip);
-                        ip += 4;
-                        std::string name = ReadString(ip, nameLen);
-                        ip += nameLen;
-                        logger.Debug("Skipping DEF function '{}'", name);
-                        break;
-                    }
+        // Not const: quickening rewrites instructions in place
+        auto& code = instructions;
+        const auto& constants = program->constants;
+        const size_t end = code.size();
+        const bool trace = logger.IsEnabled(Util::Logger::Level::Debug);
+        const Instruction* ins = nullptr;
+        uint64_t count = 0;
+
+        // Slots of the innermost call frame, reloaded whenever a frame is pushed or popped
+        Types::Value* frame = callStack.Top().slots;
+        uint32_t frameSize = callStack.Top().size;
+
+#if DOTNYET_THREADED_DISPATCH
+        // Direct threading: resolve the handler address of every instruction up front.
+        // One extra entry past the end finishes execution, so falling off the end of
+        // the code needs no bounds check on the dispatch path.
+        std::vector<const void*> handlers;
+        const void* table[256];
+        if constexpr (Threaded) {
+            std::fill(std::begin(table), std::end(table), &&op_UNKNOWN);
+            table[static_cast<uint8_t>(Opcode::NOP)] = &&op_NOP;
+            table[static_cast<uint8_t>(Opcode::PUSH)] = &&op_PUSH;
+            table[static_cast<uint8_t>(Opcode::POP)] = &&op_POP;
+            table[static_cast<uint8_t>(Opcode::CMP)] = &&op_CMP;
+            table[static_cast<uint8_t>(Opcode::DEF)] = &&op_DEF;
+            table[static_cast<uint8_t>(Opcode::CALL)] = &&op_CALL;
+            table[static_cast<uint8_t>(Opcode::RET)] = &&op_RET;
+            table[static_cast<uint8_t>(Opcode::STORE)] = &&op_STORE;
+            table[static_cast<uint8_t>(Opcode::LOAD)] = &&op_LOAD;
+            table[static_cast<uint8_t>(Opcode::JMP)] = &&op_JMP;
+            table[static_cast<uint8_t>(Opcode::JZ)] = &&op_JZ;
+            table[static_cast<uint8_t>(Opcode::JNZ)] = &&op_JNZ;
+            table[static_cast<uint8_t>(Opcode::HALT)] = &&op_HALT;
+            table[static_cast<uint8_t>(Opcode::PRINT)] = &&op_PRINT;
+            table[static_cast<uint8_t>(Opcode::INPUT)] = &&op_INPUT;
+            table[static_cast<uint8_t>(Opcode::ADD)] = &&op_ADD;
+            table[static_cast<uint8_t>(Opcode::SUB)] = &&op_SUB;
+            table[static_cast<uint8_t>(Opcode::MUL)] = &&op_MUL;
+            table[static_cast<uint8_t>(Opcode::DIV)] = &&op_DIV;
+            table[static_cast<uint8_t>(Opcode::TOINT)] = &&op_TOINT;
+            table[static_cast<uint8_t>(Opcode::SUBSTR)] = &&op_SUBSTR;
+            table[static_cast<uint8_t>(Opcode::ADD_LOCAL_CONST)] = &&op_ADD_LOCAL_CONST;
+            table[static_cast<uint8_t>(Opcode::CMP_JNZ_LOCALS)] = &&op_CMP_JNZ_LOCALS;
+            table[static_cast<uint8_t>(Opcode::CMP_JNZ_LOCAL_CONST)] = &&op_CMP_JNZ_LOCAL_CONST;
+            table[static_cast<uint8_t>(Opcode::LOAD_CONST_STORE)] = &&op_LOAD_CONST_STORE;
+            table[static_cast<uint8_t>(Opcode::INPUT_INT)] = &&op_INPUT_INT;
+            table[static_cast<uint8_t>(Opcode::TAIL_CALL)] = &&op_TAIL_CALL;
+            table[static_cast<uint8_t>(Opcode::ADD_II)] = &&op_ADD_II;
+            table[static_cast<uint8_t>(Opcode::ADD_DD)] = &&op_ADD_DD;
+            table[static_cast<uint8_t>(Opcode::ADD_SS)] = &&op_ADD_SS;
+            table[static_cast<uint8_t>(Opcode::SUB_II)] = &&op_SUB_II;
+            table[static_cast<uint8_t>(Opcode::MUL_II)] = &&op_MUL_II;
+            table[static_cast<uint8_t>(Opcode::MUL_DD)] = &&op_MUL_DD;
+            table[static_cast<uint8_t>(Opcode::DIV_II)] = &&op_DIV_II;
+            table[static_cast<uint8_t>(Opcode::DIV_DD)] = &&op_DIV_DD;
+            table[static_cast<uint8_t>(Opcode::CMP_II)] = &&op_CMP_II;
+            table[static_cast<uint8_t>(Opcode::CMP_SS)] = &&op_CMP_SS;
+            table[static_cast<uint8_t>(Opcode::CMP_II_JZ)] = &&op_CMP_II_JZ;
+            table[static_cast<uint8_t>(Opcode::CMP_II_JNZ)] = &&op_CMP_II_JNZ;
+            table[static_cast<uint8_t>(Opcode::JZ_B)] = &&op_JZ_B;
+            table[static_cast<uint8_t>(Opcode::JNZ_B)] = &&op_JNZ_B;
+
+            handlers.reserve(end + 1);
+            for (const auto& instruction : code)
+                handlers.push_back(table[static_cast<uint8_t>(instruction.op)]);
+            handlers.push_back(&&finished);
+        }
+#endif
+
+        // Rewrites the instruction at `at` in place, and for the threaded
+        // engine the handler it dispatches to
+        auto rewrite = [&](size_t at, Opcode op) {
+            NYET_LOG_DEBUG(logger, "Rewriting instruction {} from 0x{:02X} to 0x{:02X}", at,
+                static_cast<uint8_t>(code[at].op), static_cast<uint8_t>(op));
+            code[at].op = op;
+#if DOTNYET_THREADED_DISPATCH
+            if constexpr (Threaded)
+                handlers[at] = table[static_cast<uint8_t>(op)];
+#endif
+        };
+
+        // Quickens the generic instruction at `at` into `op`, unless its
+        // operand types have kept changing
+        auto quicken = [&](size_t at, Opcode op) {
+            if (quickening && op != code[at].op && quickenMisses[at] < MaxQuickenMisses)
+                rewrite(at, op);
+        };
+
+        auto deoptimize = [&](size_t at, Opcode generic) {
+            quickenMisses[at]++;
+            rewrite(at, generic);
+        };
+
+        try {
+            VM_DISPATCH();
+
+        dispatch:
+            if (ip >= end)
+                goto finished;
+            if (trace) Trace(ip);
+            ins = code.data() + ip++;
+            ++count;
+            if constexpr (Profiled) profiler->Count(ins->op);
+
+            switch (ins->op) {
+            VM_TARGET(HALT)
+                NYET_LOG_DEBUG(logger, "HALT");
+                executed += count;
+                output.Flush();
+                return;
+
+            VM_TARGET(NOP)
+                NYET_LOG_DEBUG(logger, "NOP");
+                VM_DISPATCH();
+
+            VM_TARGET(PUSH) {
+                const Types::Value& val = constants[ins->operand];
+                NYET_LOG_DEBUG(logger, "PUSH {}", val.ToString());
+                stack.Push(val);
+            }
+            VM_DISPATCH();
 
-                    case Opcode::CALL: {
-                        uint32_t nameLen = ReadUInt32(ip);
-                        ip += 4;
-                        std::string name = ReadString(ip, nameLen);
-                        ip += nameLen;
+            VM_TARGET(POP) {
+                NYET_LOG_DEBUG(logger, "POP");
+                auto popped = Checked ? stack.Pop() : stack.TakeTop();
+                NYET_LOG_DEBUG(logger, "Popped value: {}", popped.ToString());
+            }
+            VM_DISPATCH();
+
+            VM_TARGET(ADD) {
+                NYET_LOG_DEBUG(logger, "ADD");
+                if constexpr (Checked) stack.Require(2);
+                const auto& b = stack.Top(0);
+                auto& a = stack.Top(1);
+                NYET_LOG_DEBUG(logger, "Operands: a = {}, b = {}", a.ToString(), b.ToString());
+                quicken(ip - 1, Specialize(Opcode::ADD, a, b));
+                if (a.IsString() && b.IsString()) {
+                    // Extends `a` in place when nothing else refers to it
+                    a.Append(b.AsString());
+                    stack.DropTop();
+                } else {
+                    stack.ReplaceTop(2, a + b);
+                }
+                NYET_LOG_DEBUG(logger, "Result: {}", stack.Top().ToString());
+            }
+            VM_DISPATCH();
+
+            VM_TARGET(SUB) {
+                NYET_LOG_DEBUG(logger, "SUB");
+                if constexpr (Checked) stack.Require(2);
+                const auto& a = stack.Top(0);
+                const auto& b = stack.Top(1);
+                NYET_LOG_DEBUG(logger, "Operands: a = {}, b = {}", a.ToString(), b.ToString());
+                quicken(ip - 1, Specialize(Opcode::SUB, a, b));
+                stack.ReplaceTop(2, a - b);
+                NYET_LOG_DEBUG(logger, "Result: {}", stack.Top().ToString());
+            }
+            VM_DISPATCH();
+
+            VM_TARGET(MUL) {
+                NYET_LOG_DEBUG(logger, "MUL");
+                if constexpr (Checked) stack.Require(2);
+                const auto& a = stack.Top(0);
+                const auto& b = stack.Top(1);
+                NYET_LOG_DEBUG(logger, "Operands: a = {}, b = {}", a.ToString(), b.ToString());
+                quicken(ip - 1, Specialize(Opcode::MUL, a, b));
+                stack.ReplaceTop(2, a * b);
+                NYET_LOG_DEBUG(logger, "Result: {}", stack.Top().ToString());
+            }
+            VM_DISPATCH();
+
+            VM_TARGET(DIV) {
+                NYET_LOG_DEBUG(logger, "DIV");
+                if constexpr (Checked) stack.Require(2);
+                const auto& a = stack.Top(0);
+                const auto& b = stack.Top(1);
+                NYET_LOG_DEBUG(logger, "Operands: a = {}, b = {}", a.ToString(), b.ToString());
+                quicken(ip - 1, Specialize(Opcode::DIV, a, b));
+                stack.ReplaceTop(2, a / b);
+                NYET_LOG_DEBUG(logger, "Result: {}", stack.Top().ToString());
+            }
+            VM_DISPATCH();
 
-                        auto it = functionTable.find(name);
-                        if (it == functionTable.end())
-                            throw Core::RuntimeException(fmt::format("Unknown function '{}'", name));
+            VM_TARGET(PRINT) {
+                auto val = Checked ? stack.Pop() : stack.TakeTop();
+                output.Write(val);
+            }
+            VM_DISPATCH();
 
-                        logger.Debug("CALL function '{}'", name);
-                        callStack.push_back(ip);
-                        ip = it->second;
-                        break;
+            VM_TARGET(DEF) {
+                NYET_LOG_DEBUG(logger, "Skipping DEF function '{}'", program->functions[ins->operand].name);
+            }
+            VM_DISPATCH();
+
+            VM_TARGET(CALL) {
+                const auto& function = program->functions[ins->operand];
+                NYET_LOG_DEBUG(logger, "CALL function '{}'", function.name);
+                PushFrame(function, ip);
+                ip = function.entry;
+                frame = callStack.Top().slots;
+                frameSize = callStack.Top().size;
+                if constexpr (Profiled) {
+                    profiler->Enter(ins->operand);
+                } else if constexpr (!Checked) {
+                    if (jit) RunCompiled(jit->Tick(ins->operand), frame);
+                }
+            }
+            VM_DISPATCH();
+
+            VM_TARGET(TAIL_CALL) {
+                // CALL; RET: the caller has nothing left to do, so the callee
+                // takes over its frame and returns straight to its caller
+                if constexpr (Checked) {
+                    // A STORE outside the frame must still fail after the call returns
+                    if (code[ip].op == Opcode::STORE && code[ip].operand >= frameSize) {
+                        rewrite(ip - 1, Opcode::CALL);
+                        --ip;
+                        --count;
+                        VM_DISPATCH();
                     }
+                }
+                const auto& function = program->functions[ins->operand];
+                NYET_LOG_DEBUG(logger, "TAIL_CALL function '{}'", function.name);
+                // Its slots start out uninitialized, like after a CALL
+                callStack.Replace(ins->operand, function.localCount);
+                ip = function.entry;
+                frame = callStack.Top().slots;
+                frameSize = callStack.Top().size;
+                if constexpr (Profiled) {
+                    profiler->Leave();
+                    profiler->Enter(ins->operand);
+                } else if constexpr (!Checked) {
+                    if (jit) RunCompiled(jit->Tick(ins->operand), frame);
+                }
+            }
+            VM_DISPATCH();
 
-                    case Opcode::RET: {
-                        if (callStack.empty())
-                            throw Core::RuntimeException("RET with empty call stack");
-
-                        ip = callStack.back();
-                        callStack.pop_back();
-                        Types::Value val = stack.Peek(); // Return code shouldve been pushed to stack
-                        logger.Debug("RET to {}, return value: '{}'", ip, val.ToString());
-                        break;
-                    }
+            VM_TARGET(RET) {
+                if constexpr (Checked) {
+                    if (callStack.Empty())
+                        throw Core::RuntimeException("RET with empty call stack");
+                }
 
-                    case Opcode::STORE: {
-                        uint32_t address = ReadUInt32(ip);
-                        ip += 4;
-                    
-                        Types::Value val = stack.Pop();
-                        logger.Debug("STORE at address {}: {}", address, val.ToString());
-                
-                        memory[address] = val;
-                        break;
-                    }
-                    
-                    case Opcode::LOAD: {
-                        uint32_t address = ReadUInt32(ip);
-                        ip += 4;
-                    
-                        auto it = memory.find(address);
-                        if (it == memory.end())
-                            throw Core::RuntimeException(fmt::format("No value stored at address {}", address));
-                    
-                        logger.Debug("LOAD from address {}: {}", address, it->second.ToString());
-                        stack.Push(it->second);
-                        break;
-                    }                    
-
-                    case Opcode::JMP: {
-                        uint32_t target = ReadUInt32(ip); ip += 4;
-                        logger.Debug("JMP to {}", target);
-                        ip = target;
-                        break;
+                ip = callStack.Pop();
+                if constexpr (Profiled) profiler->Leave();
+                if (!callStack.Empty()) {
+                    frame = callStack.Top().slots;
+                    frameSize = callStack.Top().size;
+                    if constexpr (!Checked && !Profiled) {
+                        if (jit) RunCompiled(jit->Find(callStack.Top().function), frame);
                     }
+                }
+                const Types::Value& val = Checked ? stack.Peek() : stack.Top(); // Return code shouldve been pushed to stack
+                NYET_LOG_DEBUG(logger, "RET to {}, return value: '{}'", ip, val.ToString());
+            }
+            VM_DISPATCH();
 
-                    case Opcode::JZ: {
-                        uint32_t target = ReadUInt32(ip); ip += 4;
-                        Types::Value cond = stack.Pop();
-                        if (!cond.IsTruthy()) {
-                            logger.Debug("JZ to {}", target);
-                            ip = target;
-                        } else {
-                            logger.Debug("JZ skipped");
-                        }
-                        break;
-                    }
+            VM_TARGET(STORE) {
+                uint32_t address = ins->operand;
+                if constexpr (Checked) {
+                    if (address >= frameSize)
+                        throw Core::RuntimeException(fmt::format("Address {} is outside the current call frame", address));
+                }
 
-                    case Opcode::JNZ: {
-                        uint32_t target = ReadUInt32(ip); ip += 4;
-                        Types::Value cond = stack.Pop();
-                        if (cond.IsTruthy()) {
-                            logger.Debug("JNZ to {}", target);
-                            ip = target;
-                        } else {
-                            logger.Debug("JNZ skipped");
-                        }
-                        break;
-                    }
+                Types::Value val = Checked ? stack.Pop() : stack.TakeTop();
+                NYET_LOG_DEBUG(logger, "STORE at address {}: {}", address, val.ToString());
+                frame[address] = std::move(val);
+            }
+            VM_DISPATCH();
+            
+            VM_TARGET(LOAD) {
+                uint32_t address = ins->operand;
+                if constexpr (Checked) {
+                    if (address >= frameSize || frame[address].IsUninitialized())
+                        throw Core::RuntimeException(fmt::format("No value stored at address {}", address));
+                }
 
-                    case Opcode::CMP: {
-                        logger.Debug("CMP");
-                        auto b = stack.Pop();
-                        auto a = stack.Pop();
-                        logger.Debug("Operands: a = {}, b = {}", a.ToString(), b.ToString());
-
-                        if (a.Type() == b.Type()) {
-                            if (a.IsInt() && b.IsInt()) {
-                                stack.Push(Types::Value(a.AsInt() == b.AsInt()));
-                            } else if (a.IsDouble() && b.IsDouble()) {
-                                stack.Push(Types::Value(a.AsDouble() == b.AsDouble()));
-                            } else if (a.IsString() && b.IsString()) {
-                                stack.Push(Types::Value(a.AsString() == b.AsString()));
-                            } else {
-                                throw Core::RuntimeException("Unsupported comparison types");
-                            }
-                        } else {
-                            throw Core::RuntimeException("Cannot compare different types");
-                        }
-                        logger.Debug(stack.Peek().ToString());
-                        break;
-                    }
+                NYET_LOG_DEBUG(logger, "LOAD from address {}: {}", address, frame[address].ToString());
+                stack.Push(frame[address]);
+            }
+            VM_DISPATCH();
 
-                    case Opcode::INPUT: {
-                        logger.Debug("INPUT");
-                        std::string input;
-                        std::getline(std::cin, input);
-                        logger.Debug("Result: {}", input);
-                        stack.Push(Types::Value(input));
-                        break;
-                    }
+            VM_TARGET(JMP) {
+                uint32_t target = ins->operand;
+                NYET_LOG_DEBUG(logger, "JMP to {}", target);
+                VM_BRANCH(target);
+            }
+            VM_DISPATCH();
+
+            VM_TARGET(JZ) {
+                uint32_t target = ins->operand;
+                if constexpr (Checked) stack.Require(1);
+                const Types::Value& top = stack.Top();
+                if (top.IsBool())
+                    quicken(ip - 1, Opcode::JZ_B);
+                bool truthy = top.IsTruthy();
+                stack.DropTop();
+                if (!truthy) {
+                    NYET_LOG_DEBUG(logger, "JZ to {}", target);
+                    VM_BRANCH(target);
+                } else {
+                    NYET_LOG_DEBUG(logger, "JZ skipped");
+                }
+            }
+            VM_DISPATCH();
+
+            VM_TARGET(JNZ) {
+                uint32_t target = ins->operand;
+                if constexpr (Checked) stack.Require(1);
+                const Types::Value& top = stack.Top();
+                if (top.IsBool())
+                    quicken(ip - 1, Opcode::JNZ_B);
+                bool truthy = top.IsTruthy();
+                stack.DropTop();
+                if (truthy) {
+                    NYET_LOG_DEBUG(logger, "JNZ to {}", target);
+                    VM_BRANCH(target);
+                } else {
+                    NYET_LOG_DEBUG(logger, "JNZ skipped");
+                }
+            }
+            VM_DISPATCH();
+
+            VM_TARGET(CMP) {
+                NYET_LOG_DEBUG(logger, "CMP");
+                if constexpr (Checked) stack.Require(2);
+                const auto& b = stack.Top(0);
+                const auto& a = stack.Top(1);
+                NYET_LOG_DEBUG(logger, "Operands: a = {}, b = {}", a.ToString(), b.ToString());
+
+                Opcode quickened = Specialize(Opcode::CMP, a, b);
+                // Int comparisons usually feed a conditional jump; take it along
+                if (quickened == Opcode::CMP_II && ip < end) {
+                    Opcode next = Generic(code[ip].op);
+                    if (next == Opcode::JZ)
+                        quickened = Opcode::CMP_II_JZ;
+                    else if (next == Opcode::JNZ)
+                        quickened = Opcode::CMP_II_JNZ;
+                }
+                quicken(ip - 1, quickened);
 
-                    case Opcode::TOINT: {
-                        logger.Debug("TOINT");
-                        Types::Value val = stack.Pop();
-                        if (val.IsDouble()) {
-                            stack.Push(Types::Value(static_cast<int64_t>(val.AsDouble())));
-                        } else if (val.IsString()) {
-                            try {
-                                int64_t intValue = std::stoll(val.AsString());
-                                stack.Push(Types::Value(intValue));
-                            } catch (const std::invalid_argument&) {
-                                throw Core::RuntimeException("Invalid string for conversion to int");
-                            }
-                        } else if (val.IsInt()) {
-                            stack.Push(val);
-                        } else {
-                            throw Core::RuntimeException("Unsupported type for TOINT");
-                        }
-                        break;
-                    }
+                bool equal = Types::Equals(a, b);
+                stack.ReplaceTop(2, Types::Value(equal));
+                NYET_LOG_DEBUG(logger, "Result: {}", stack.Peek().ToString());
+            }
+            VM_DISPATCH();
+
+            VM_TARGET(INPUT) {
+                NYET_LOG_DEBUG(logger, "INPUT");
+                // Make sure any prompt is visible before blocking on input
+                output.Flush();
+                std::string_view line = input.ReadLine();
+                NYET_LOG_DEBUG(logger, "Result: {}", line);
+                stack.Emplace(line);
+            }
+            VM_DISPATCH();
+
+            VM_TARGET(TOINT) {
+                NYET_LOG_DEBUG(logger, "TOINT");
+                if constexpr (Checked) stack.Require(1);
+                Types::Value& val = stack.Top();
+                if (!val.IsInt())
+                    val = Types::Value(Types::ToInt(val));
+            }
+            VM_DISPATCH();
+
+            VM_TARGET(SUBSTR) {
+                NYET_LOG_DEBUG(logger, "SUBSTR");
+                if constexpr (Checked) stack.Require(3);
+                Types::Value result = Types::Substr(stack.Top(2), stack.Top(1), stack.Top(0));
+                NYET_LOG_DEBUG(logger, "Result: '{}'", result.ToString());
+                stack.ReplaceTop(3, std::move(result));
+            }
+            VM_DISPATCH();
+
+            // Superinstructions skip the instructions they were fused from
+            VM_TARGET(INPUT_INT) {
+                output.Flush();
+                std::string_view line = input.ReadLine();
+                NYET_LOG_DEBUG(logger, "INPUT_INT: '{}'", line);
+                stack.Emplace(Types::ParseInt(line));
+                ip += 1;
+            }
+            VM_DISPATCH();
 
-                    case Opcode::SUBSTR: {
-                        logger.Debug("SUBSTR");
-                        auto end = stack.Pop();
-                        auto start = stack.Pop();
-                        auto strVal = stack.Pop();
+            VM_TARGET(ADD_LOCAL_CONST) {
+                uint32_t address = ins->operand;
+                if constexpr (Checked) {
+                    if (address >= frameSize || frame[address].IsUninitialized())
+                        throw Core::RuntimeException(fmt::format("No value stored at address {}", address));
+                }
 
-                        if (!strVal.IsString() || !start.IsInt() || !end.IsInt())
-                            throw Core::RuntimeException("SUBSTR expects a string and two integers");
+                Types::Value& slot = frame[address];
+                const Types::Value& constant = constants[ins[1].operand];
+                NYET_LOG_DEBUG(logger, "ADD_LOCAL_CONST at address {}: {} + {}", address, slot.ToString(), constant.ToString());
+                if (slot.IsInt() && constant.IsInt())
+                    slot = Types::Value(slot.AsInt() + constant.AsInt());
+                else if (slot.IsString() && constant.IsString())
+                    slot.Append(constant.AsString());
+                else
+                    slot = slot + constant;
+                ip += 3;
+            }
+            VM_DISPATCH();
+
+            VM_TARGET(CMP_JNZ_LOCALS) {
+                uint32_t lhs = ins->operand;
+                uint32_t rhs = ins[1].operand;
+                if constexpr (Checked) {
+                    if (lhs >= frameSize || frame[lhs].IsUninitialized())
+                        throw Core::RuntimeException(fmt::format("No value stored at address {}", lhs));
+                    if (rhs >= frameSize || frame[rhs].IsUninitialized())
+                        throw Core::RuntimeException(fmt::format("No value stored at address {}", rhs));
+                }
 
-                        const std::string& str = strVal.AsString();
-                        int64_t startIdx = start.AsInt();
-                        int64_t endIdx = end.AsInt();
+                bool equal = Types::Equals(frame[lhs], frame[rhs]);
+                NYET_LOG_DEBUG(logger, "CMP_JNZ_LOCALS {} == {}: {}", lhs, rhs, equal);
+                if (equal)
+                    VM_BRANCH(ins[3].operand);
+                else
+                    ip += 3;
+            }
+            VM_DISPATCH();
 
-                        if (startIdx < 0 || endIdx < 0 || startIdx >= str.size() || endIdx > str.size() || startIdx > endIdx)
-                            throw Core::RuntimeException("Invalid indices for SUBSTR");
+            VM_TARGET(CMP_JNZ_LOCAL_CONST) {
+                uint32_t address = ins->operand;
+                if constexpr (Checked) {
+                    if (address >= frameSize || frame[address].IsUninitialized())
+                        throw Core::RuntimeException(fmt::format("No value stored at address {}", address));
+                }
 
-                        std::string result = str.substr(startIdx, endIdx - startIdx);
-                        logger.Debug("Result: '{}'", result);
-                        stack.Push(Types::Value(result));
-                        break;
-                    }
+                bool equal = Types::Equals(frame[address], constants[ins[1].operand]);
+                NYET_LOG_DEBUG(logger, "CMP_JNZ_LOCAL_CONST {} == {}: {}", address, constants[ins[1].operand].ToString(), equal);
+                if (equal)
+                    VM_BRANCH(ins[3].operand);
+                else
+                    ip += 3;
+            }
+            VM_DISPATCH();
 
-                    default:
-                        throw Core::RuntimeException(fmt::format("Unknown opcode: 0x{:02X}", static_cast<uint8_t>(op)));
+            VM_TARGET(LOAD_CONST_STORE) {
+                uint32_t address = ins[1].operand;
+                if constexpr (Checked) {
+                    if (address >= frameSize)
+                        throw Core::RuntimeException(fmt::format("Address {} is outside the current call frame", address));
                 }
-            } catch (const std::exception& e) {
-                logger.Warn("Exception at ip={} opcode=0x{:02X}: {}", ip - 1, static_cast<uint8_t>(op), e.what());
-                throw;
+
+                NYET_LOG_DEBUG(logger, "LOAD_CONST_STORE at address {}: {}", address, constants[ins->operand].ToString());
+                frame[address] = constants[ins->operand];
+                ip += 1;
+            }
+            VM_DISPATCH();
+
+            // Quickened forms check their operand types and otherwise do what
+            // the generic instruction does for those types
+            VM_TARGET(ADD_II) {
+                if constexpr (Checked) stack.Require(2);
+                const auto& b = stack.Top(0);
+                auto& a = stack.Top(1);
+                if (!a.IsInt() || !b.IsInt())
+                    VM_DEOPTIMIZE(ADD);
+                a = Types::Value(a.IntUnchecked() + b.IntUnchecked());
+                stack.DropTop();
+            }
+            VM_DISPATCH();
+
+            VM_TARGET(ADD_DD) {
+                if constexpr (Checked) stack.Require(2);
+                const auto& b = stack.Top(0);
+                auto& a = stack.Top(1);
+                if (!a.IsDouble() || !b.IsDouble())
+                    VM_DEOPTIMIZE(ADD);
+                a = Types::Value(a.DoubleUnchecked() + b.DoubleUnchecked());
+                stack.DropTop();
             }
+            VM_DISPATCH();
+
+            VM_TARGET(ADD_SS) {
+                if constexpr (Checked) stack.Require(2);
+                const auto& b = stack.Top(0);
+                auto& a = stack.Top(1);
+                if (!a.IsString() || !b.IsString())
+                    VM_DEOPTIMIZE(ADD);
+                a.Append(b.AsString());
+                stack.DropTop();
+            }
+            VM_DISPATCH();
+
+            // SUB, MUL and DIV compute Top(0) op Top(1)
+            VM_TARGET(SUB_II) {
+                if constexpr (Checked) stack.Require(2);
+                const auto& a = stack.Top(0);
+                auto& b = stack.Top(1);
+                if (!a.IsInt() || !b.IsInt())
+                    VM_DEOPTIMIZE(SUB);
+                b = Types::Value(a.IntUnchecked() - b.IntUnchecked());
+                stack.DropTop();
+            }
+            VM_DISPATCH();
+
+            VM_TARGET(MUL_II) {
+                if constexpr (Checked) stack.Require(2);
+                const auto& a = stack.Top(0);
+                auto& b = stack.Top(1);
+                if (!a.IsInt() || !b.IsInt())
+                    VM_DEOPTIMIZE(MUL);
+                b = Types::Value(a.IntUnchecked() * b.IntUnchecked());
+                stack.DropTop();
+            }
+            VM_DISPATCH();
+
+            VM_TARGET(MUL_DD) {
+                if constexpr (Checked) stack.Require(2);
+                const auto& a = stack.Top(0);
+                auto& b = stack.Top(1);
+                if (!a.IsDouble() || !b.IsDouble())
+                    VM_DEOPTIMIZE(MUL);
+                b = Types::Value(a.DoubleUnchecked() * b.DoubleUnchecked());
+                stack.DropTop();
+            }
+            VM_DISPATCH();
+
+            VM_TARGET(DIV_II) {
+                if constexpr (Checked) stack.Require(2);
+                const auto& a = stack.Top(0);
+                auto& b = stack.Top(1);
+                if (!a.IsInt() || !b.IsInt())
+                    VM_DEOPTIMIZE(DIV);
+                if (b.IntUnchecked() == 0)
+                    throw Core::RuntimeException("Division by zero");
+                b = Types::Value(a.IntUnchecked() / b.IntUnchecked());
+                stack.DropTop();
+            }
+            VM_DISPATCH();
+
+            VM_TARGET(DIV_DD) {
+                if constexpr (Checked) stack.Require(2);
+                const auto& a = stack.Top(0);
+                auto& b = stack.Top(1);
+                if (!a.IsDouble() || !b.IsDouble())
+                    VM_DEOPTIMIZE(DIV);
+                if (b.DoubleUnchecked() == 0.0)
+                    throw Core::RuntimeException("Division by zero");
+                b = Types::Value(a.DoubleUnchecked() / b.DoubleUnchecked());
+                stack.DropTop();
+            }
+            VM_DISPATCH();
+
+            VM_TARGET(CMP_II) {
+                if constexpr (Checked) stack.Require(2);
+                const auto& b = stack.Top(0);
+                auto& a = stack.Top(1);
+                if (!a.IsInt() || !b.IsInt())
+                    VM_DEOPTIMIZE(CMP);
+                a = Types::Value(a.IntUnchecked() == b.IntUnchecked());
+                stack.DropTop();
+            }
+            VM_DISPATCH();
+
+            VM_TARGET(CMP_SS) {
+                if constexpr (Checked) stack.Require(2);
+                const auto& b = stack.Top(0);
+                auto& a = stack.Top(1);
+                if (!a.IsString() || !b.IsString())
+                    VM_DEOPTIMIZE(CMP);
+                bool equal = a.AsStringObject() == b.AsStringObject() || a.AsString() == b.AsString();
+                a = Types::Value(equal);
+                stack.DropTop();
+            }
+            VM_DISPATCH();
+
+            // Also run the conditional jump after them, which is left in place
+            VM_TARGET(CMP_II_JZ) {
+                if constexpr (Checked) stack.Require(2);
+                const auto& b = stack.Top(0);
+                const auto& a = stack.Top(1);
+                if (!a.IsInt() || !b.IsInt())
+                    VM_DEOPTIMIZE(CMP);
+                bool equal = a.IntUnchecked() == b.IntUnchecked();
+                stack.DropTop(2);
+                // Counted as the two instructions it stands for, as before quickening
+                ++count;
+                if (!equal)
+                    VM_BRANCH(ins[1].operand);
+                else
+                    ip += 1;
+            }
+            VM_DISPATCH();
+
+            VM_TARGET(CMP_II_JNZ) {
+                if constexpr (Checked) stack.Require(2);
+                const auto& b = stack.Top(0);
+                const auto& a = stack.Top(1);
+                if (!a.IsInt() || !b.IsInt())
+                    VM_DEOPTIMIZE(CMP);
+                bool equal = a.IntUnchecked() == b.IntUnchecked();
+                stack.DropTop(2);
+                // Counted as the two instructions it stands for, as before quickening
+                ++count;
+                if (equal)
+                    VM_BRANCH(ins[1].operand);
+                else
+                    ip += 1;
+            }
+            VM_DISPATCH();
+
+            VM_TARGET(JZ_B) {
+                if constexpr (Checked) stack.Require(1);
+                const auto& top = stack.Top();
+                if (!top.IsBool())
+                    VM_DEOPTIMIZE(JZ);
+                bool truthy = top.BoolUnchecked();
+                stack.DropTop();
+                if (!truthy)
+                    VM_BRANCH(ins->operand);
+            }
+            VM_DISPATCH();
+
+            VM_TARGET(JNZ_B) {
+                if constexpr (Checked) stack.Require(1);
+                const auto& top = stack.Top();
+                if (!top.IsBool())
+                    VM_DEOPTIMIZE(JNZ);
+                bool truthy = top.BoolUnchecked();
+                stack.DropTop();
+                if (truthy)
+                    VM_BRANCH(ins->operand);
+            }
+            VM_DISPATCH();
+
+            default:
+            VM_LABEL(UNKNOWN)
+                throw Core::RuntimeException(fmt::format("Unknown opcode: 0x{:02X}", static_cast<uint8_t>(ins->op)));
+            }
+
+        finished:
+            // The threaded engine counts its final dispatch to the end sentinel
+            if constexpr (Threaded) --count;
+            executed += count;
+            output.Flush();
+            logger.Info("Execution finished successfully.");
+        } catch (const std::exception& e) {
+            executed += count;
+            output.Flush();
+            if (ins)
+                logger.Warn("Exception at ip={} opcode=0x{:02X}: {}", ip - 1, static_cast<uint8_t>(ins->op), e.what());
+            else
+                logger.Warn("Exception before the first instruction: {}", e.what());
+            throw;
         }
+    }
+
+#undef VM_DEOPTIMIZE
+#undef VM_BRANCH
+#undef VM_DISPATCH
+#undef VM_TARGET
+#undef VM_LABEL
+
+    void VirtualMachine::SetVerification(bool enabled) {
+        verify = enabled;
+    }
+
+    bool VirtualMachine::IsVerificationEnabled() const {
+        return verify;
+    }
 
-        logger.Info("Execution finished successfully.");
+    void VirtualMachine::SetOptimization(bool enabled) {
+        optimize = enabled;
+    }
+
+    bool VirtualMachine::IsOptimizationEnabled() const {
+        return optimize;
+    }
+
+    const VirtualMachine::PrepareStats& VirtualMachine::GetPrepareStats() const {
+        return prepareStats;
+    }
+
+    void VirtualMachine::SetMaxCallDepth(uint32_t depth) {
+        if (depth == 0)
+            throw Core::RuntimeException("The maximum call depth must be at least 1");
+        maxCallDepth = depth;
+    }
+
+    uint32_t VirtualMachine::GetMaxCallDepth() const {
+        return maxCallDepth;
+    }
+
+    void VirtualMachine::SetQuickening(bool enabled) {
+        quickening = enabled;
+    }
+
+    bool VirtualMachine::IsQuickeningEnabled() const {
+        return quickening;
+    }
+
+    void VirtualMachine::SetJit(bool enabled) {
+        if (enabled && !HasJit())
+            throw Core::VMException("The JIT is not available in this build");
+        jitEnabled = enabled;
+        if (!enabled)
+            jit.reset();
+    }
+
+    bool VirtualMachine::IsJitEnabled() const {
+        return jitEnabled;
+    }
+
+    bool VirtualMachine::HasJit() {
+        return Jit::IsAvailable();
+    }
+
+    void VirtualMachine::SetJitThreshold(uint32_t threshold) {
+        jitThreshold = threshold;
+        jit.reset();
+    }
+
+    void VirtualMachine::SetProfiling(bool enabled) {
+        profiling = enabled;
+    }
+
+    bool VirtualMachine::IsProfilingEnabled() const {
+        return profiling;
+    }
+
+    const Profiler* VirtualMachine::GetProfiler() const {
+        return profiler.get();
+    }
+
+    void VirtualMachine::SetDispatchMode(DispatchMode mode) {
+        if (mode == DispatchMode::Threaded && !HasThreadedDispatch())
+            throw Core::VMException("Threaded dispatch is not available in this build");
+        dispatchMode = mode;
+    }
+
+    VirtualMachine::DispatchMode VirtualMachine::GetDispatchMode() const {
+        return dispatchMode;
+    }
+
+    bool VirtualMachine::HasThreadedDispatch() {
+#if DOTNYET_THREADED_DISPATCH
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void VirtualMachine::SetLogLevel(std::optional<Util::Logger::Level> level) {
+        logLevel = level;
+    }
+
+    std::optional<Util::Logger::Level> VirtualMachine::GetLogLevel() const {
+        return logLevel;
+    }
+
+    uint64_t VirtualMachine::GetExecutedInstructions() const {
+        return executed;
     }
 
     Stack& VirtualMachine::GetStack() {
         return stack;
     }
+
+    OutputChannel& VirtualMachine::GetOutput() {
+        return output;
+    }
+
+    InputChannel& VirtualMachine::GetInput() {
+        return input;
+    }
 }
\ No newline at end of file
@@ -0,0 +1,32 @@
+# Checks that nyasm and the Python assembler compile a program to the same
+# bytes:
+#
+#   cmake -DNYASM=<nyasm> -DPYTHON=<python> -DSCRIPT=<tools/dotnyet.py>
+#         -DSOURCE=<program.ny> -DOUTPUT=<prefix> -P CompareAssemblers.cmake
+#
+# The two bytecode files are written to <prefix>.nyasm.nyet and
+# <prefix>.python.nyet.
+
+# Runs one assembler; `what` names it in errors
+function(assemble what)
+    execute_process(
+        COMMAND ${ARGN}
+        OUTPUT_VARIABLE output
+        ERROR_VARIABLE output
+        RESULT_VARIABLE result
+    )
+    if (NOT result EQUAL 0)
+        message(FATAL_ERROR "${what} failed with exit status ${result}:\n${output}")
+    endif()
+endfunction()
+
+assemble("nyasm" ${NYASM} ${SOURCE} ${OUTPUT}.nyasm.nyet)
+assemble("dotnyet.py" ${PYTHON} ${SCRIPT} ${SOURCE} ${OUTPUT}.python.nyet)
+
+execute_process(
+    COMMAND ${CMAKE_COMMAND} -E compare_files ${OUTPUT}.nyasm.nyet ${OUTPUT}.python.nyet
+    RESULT_VARIABLE different
+)
+if (different)
+    message(FATAL_ERROR "nyasm and dotnyet.py compiled ${SOURCE} differently")
+endif()
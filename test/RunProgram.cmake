@@ -0,0 +1,53 @@
+# Runs one test program and checks what it prints:
+#
+#   cmake -DPROGRAM=<executable> [-DOPTIONS=<options>] [-DSOURCE=<program>]
+#         -DEXPECTED=<file> -DINPUT=<file> [-DERROR=<file>] [-DSNAPSHOT=<file>]
+#         -P RunProgram.cmake
+#
+# Runs PROGRAM with OPTIONS on SOURCE (left out for translated programs),
+# reading standard input from INPUT, and fails unless standard output is
+# exactly what EXPECTED holds. The run must succeed, or, if ERROR is given,
+# fail with an error matching the regular expression on its first line.
+#
+# With SNAPSHOT, the run saves a snapshot there, and the snapshot is then run
+# and checked the same way.
+
+separate_arguments(options UNIX_COMMAND "${OPTIONS}")
+file(READ ${EXPECTED} expected)
+if (ERROR)
+    file(STRINGS ${ERROR} error_pattern LIMIT_COUNT 1)
+endif()
+
+# Runs PROGRAM with OPTIONS and the given arguments; `what` names the run in errors
+function(check_run what)
+    execute_process(
+        COMMAND ${PROGRAM} ${options} ${ARGN}
+        INPUT_FILE ${INPUT}
+        OUTPUT_VARIABLE output
+        ERROR_VARIABLE error
+        RESULT_VARIABLE result
+    )
+
+    if (NOT output STREQUAL expected)
+        message(FATAL_ERROR "${what} printed:\n${output}\nExpected:\n${expected}\nStandard error:\n${error}")
+    endif()
+
+    if (error_pattern)
+        if (result EQUAL 0 OR NOT error MATCHES "${error_pattern}")
+            message(FATAL_ERROR "${what}: expected an error matching '${error_pattern}', got exit status ${result}:\n${error}")
+        endif()
+    elseif (NOT result EQUAL 0)
+        message(FATAL_ERROR "${what} failed with exit status ${result}:\n${error}")
+    endif()
+endfunction()
+
+if (SNAPSHOT)
+    file(REMOVE ${SNAPSHOT})
+    check_run("The program" --snapshot=${SNAPSHOT} ${SOURCE})
+    # A run that fails saves nothing
+    if (NOT error_pattern)
+        check_run("The snapshot" ${SNAPSHOT})
+    endif()
+else()
+    check_run("The program" ${SOURCE})
+endif()
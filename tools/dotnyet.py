@@ -27,6 +27,10 @@ class Opcode(Enum):
     TOINT  = 0x70
     SUBSTR = 0x71
 
+# Version 2 of the .nyet format: a constant pool follows the header and
+# PUSH/DEF/CALL refer to its entries by index
+FORMAT_VERSION = 0x02
+
 class ValueTypeTag(Enum):
     Null    = 0
     Integer = 1
@@ -319,6 +323,9 @@ class Compiler:
         self.local_vars: Dict[str, int] = {}
         self.local_var_count: int = 0
         self.scope_stack: List[Dict[str, int]] = [{}]
+        self.constants = bytearray()
+        self.constant_count: int = 0
+        self.constant_index: Dict[bytes, int] = {}
 
     def emit_byte(self, byte: int):
         self.bytecode.append(byte)
@@ -326,15 +333,31 @@ class Compiler:
     def emit_uint32(self, value: int):
         self.bytecode.extend(struct.pack('<I', value))
 
-    def emit_int64(self, value: int):
-        self.bytecode.extend(struct.pack('<q', value))
-
-    def emit_double(self, value: float):
-        self.bytecode.extend(struct.pack('<d', value))
-
-    def emit_string(self, value: str):
-        self.emit_uint32(len(value))
-        self.bytecode.extend(value.encode('utf-8'))
+    def encode_constant(self, value: Union[str, int, float, bool, None], line: int) -> bytes:
+        if value is None:
+            return bytes([ValueTypeTag.Null.value])
+        elif isinstance(value, bool):
+            return bytes([ValueTypeTag.Boolean.value, 1 if value else 0])
+        elif isinstance(value, int):
+            return bytes([ValueTypeTag.Integer.value]) + struct.pack('<q', value)
+        elif isinstance(value, float):
+            return bytes([ValueTypeTag.Double.value]) + struct.pack('<d', value)
+        elif isinstance(value, str):
+            data = value.encode('utf-8')
+            return bytes([ValueTypeTag.String.value]) + struct.pack('<I', len(data)) + data
+        raise ValueError(f"Invalid value at line {line}: {value}")
+
+    def constant(self, value: Union[str, int, float, bool, None], line: int = 0) -> int:
+        # Keyed by the encoding, so equal constants of different types stay apart
+        encoded = self.encode_constant(value, line)
+        if encoded not in self.constant_index:
+            self.constant_index[encoded] = self.constant_count
+            self.constant_count += 1
+            self.constants.extend(encoded)
+        return self.constant_index[encoded]
+
+    def emit_name(self, value: str):
+        self.emit_uint32(self.constant(value))
 
     def emit_value(self, value: Union[str, int, float, bool, None], line: int):
         if isinstance(value, str) and (value in self.current_params or value in self.local_vars):
@@ -346,22 +369,7 @@ class Compiler:
             self.emit_uint32(index)
         else:
             self.emit_byte(Opcode.PUSH.value)
-            if value is None:
-                self.emit_byte(ValueTypeTag.Null.value)
-            elif isinstance(value, bool):
-                self.emit_byte(ValueTypeTag.Boolean.value)
-                self.emit_byte(1 if value else 0)
-            elif isinstance(value, int):
-                self.emit_byte(ValueTypeTag.Integer.value)
-                self.emit_int64(value)
-            elif isinstance(value, float):
-                self.emit_byte(ValueTypeTag.Double.value)
-                self.emit_double(value)
-            elif isinstance(value, str):
-                self.emit_byte(ValueTypeTag.String.value)
-                self.emit_string(value)
-            else:
-                raise ValueError(f"Invalid value at line {line}: {value}")
+            self.emit_uint32(self.constant(value, line))
 
     def compile(self, source: str) -> bytes:
         lexer = Lexer(source)
@@ -381,7 +389,9 @@ class Compiler:
         self.emit_byte(Opcode.HALT.value)
 
         result = bytearray(b'NYET')
-        result.append(0x01)
+        result.append(FORMAT_VERSION)
+        result.extend(struct.pack('<I', self.constant_count))
+        result.extend(self.constants)
         result.extend(self.bytecode)
         return result
 
@@ -394,7 +404,7 @@ class Compiler:
             self.local_vars = self.scope_stack[-1]
             self.local_var_count = len(stmt.params)
             self.emit_byte(Opcode.DEF.value)
-            self.emit_string(stmt.name)
+            self.emit_name(stmt.name)
             for s in stmt.body:
                 self.compile_statement(s)
             self.current_params = self.param_stack.pop() if self.param_stack else []
@@ -428,7 +438,7 @@ class Compiler:
             for arg in reversed(stmt.args):
                 self.compile_value(arg, stmt.line)
             self.emit_byte(Opcode.CALL.value)
-            self.emit_string(stmt.name)
+            self.emit_name(stmt.name)
 
         elif isinstance(stmt, JumpNode):
             self.emit_byte(stmt.opcode.value)